@@ -13,6 +13,7 @@
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -90,6 +91,15 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Params to eval_mm_batch: one round allocates and frees n blocks */
+#define BATCH_MAX    1024 /* largest n for -b */
+#define BATCH_ROUNDS 1000 /* rounds per timing */
+typedef struct {
+    size_t size;
+    int n;
+    int batched;     /* use mm_malloc_batch/mm_free_batch */
+} batch_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* set in read_trace */
@@ -177,12 +187,18 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_batch(void *ptr);
+static void run_batch_bench(int n);
+static void run_api_checks(void);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
+static void print_frag(void);
+static void api_error(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
 static void unix_error(const char *fmt, ...)
     __attribute__((format(printf, 1,2), noreturn));
 static void app_error(const char *fmt, ...)
@@ -255,6 +271,8 @@ int main(int argc, char **argv)
     speed_t speed_params;      /* input parameters to the xx_speed routines */
 
     int run_libc = 0;     /* If set, run libc malloc (set by -l) */
+    int batch_n = 0;      /* If set, time batches of this many blocks (-b) */
+    int api_checks = 0;   /* If set, exercise the rest of mm.h (-x) */
     int autograder = 0;   /* if set then called by autograder (-A) */
 
     /* temporaries used to compute the performance index */
@@ -269,7 +287,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:b:hVAlDx")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -327,6 +345,16 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'b': /* Time mm_malloc_batch/mm_free_batch */
+            batch_n = atoi(optarg);
+            if (batch_n < 1 || batch_n > BATCH_MAX)
+                app_error("-b takes a batch size from 1 to %d", BATCH_MAX);
+            break;
+
+        case 'x': /* Check calloc, memalign, batch, regions, heaps, ... */
+            api_checks = 1;
+            break;
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -425,6 +453,12 @@ int main(int argc, char **argv)
         }
     }
 
+    if (batch_n)
+        run_batch_bench(batch_n);
+
+    if (api_checks)
+        run_api_checks();
+
     /*
      * Accumulate the aggregate statistics for the student's mm package
      */
@@ -844,6 +878,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             /* Call the student's malloc */
             if ((p = mm_malloc(size)) == NULL) {
                 malloc_error(trace, i, "mm_malloc failed.");
+                print_frag();
                 return 0;
             }
             // printf("[eval_mm_valid] malloc done\n");
@@ -873,6 +908,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             // printf("[eval_mm_valid] mm_realloc done\n");
             if( (newp == NULL) && (size != 0) ) {
                 malloc_error(trace, i, "mm_realloc failed.");
+                print_frag();
                 return 0;
             }
             if( (newp != NULL) && (size == 0) ) {
@@ -1027,7 +1063,13 @@ static double eval_mm_util(trace_t *trace, int tracenum)
     }
     */
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    if (verbose > 2) {
+        putchar('\n');
+        print_frag();
+    }
+
+    /* the heap may have been trimmed since its high-water mark */
+    return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
 
@@ -1083,6 +1125,418 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * eval_mm_batch - Used by fcyc() to time BATCH_ROUNDS rounds of
+ *    allocating and then freeing n blocks of one size, either one
+ *    block per call or with the batch calls.
+ */
+static void eval_mm_batch(void *ptr)
+{
+    batch_t *b = (batch_t *)ptr;
+    void *blocks[BATCH_MAX];
+    int i, r;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_batch");
+
+    for (r = 0; r < BATCH_ROUNDS; r++) {
+        if (b->batched) {
+            if (mm_malloc_batch(b->size, b->n, blocks) != (size_t)b->n)
+                app_error("mm_malloc_batch error in eval_mm_batch");
+            mm_free_batch(blocks, b->n);
+        } else {
+            for (i = 0; i < b->n; i++)
+                if ((blocks[i] = mm_malloc(b->size)) == NULL)
+                    app_error("mm_malloc error in eval_mm_batch");
+            for (i = 0; i < b->n; i++)
+                mm_free(blocks[i]);
+        }
+    }
+}
+
+/*
+ * run_batch_bench - Compare single and batch calls for blocks of
+ *    n blocks at a time over a range of sizes.
+ */
+static void run_batch_bench(int n)
+{
+    static const size_t sizes[] = {16, 64, 128, 256, 1024, 4096};
+    batch_t b;
+    double ops = 2.0 * n * BATCH_ROUNDS;
+    double single, batched;
+    int i;
+
+    printf("Batches of %d blocks (Kops/s):\n", n);
+    printf("%8s%10s%10s\n", "size", "single", "batch");
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        b.size = sizes[i];
+        b.n = n;
+        b.batched = 0;
+        single = fsecs(eval_mm_batch, &b);
+        b.batched = 1;
+        batched = fsecs(eval_mm_batch, &b);
+        printf("%8zu%10.0f%10.0f\n", sizes[i], ops / single / 1e3, ops / batched / 1e3);
+    }
+    printf("\n");
+}
+
+/*
+ * The checks of run_api_checks. Each works on a fresh heap and leaves
+ * nothing allocated; run_api_checks runs mm_check after each one.
+ */
+#define API_BLOCKS 64
+#define ALIGNED(p, a) (((uintptr_t)(p) & ((a) - 1)) == 0)
+
+/* mm_calloc returns zeroed memory, also where a freed block was */
+static void check_calloc(void)
+{
+    char *p, *q;
+    size_t i;
+
+    if ((p = mm_malloc(4000)) == NULL)
+        api_error("mm_malloc(4000) failed");
+    else {
+        memset(p, 0xff, 4000);
+        mm_free(p);
+    }
+    if ((q = mm_calloc(500, 8)) == NULL)
+        api_error("mm_calloc(500, 8) failed");
+    else {
+        for (i = 0; i < 4000 && !q[i]; i++)
+            ;
+        if (i < 4000)
+            api_error("mm_calloc(500, 8) byte %zu is not zero", i);
+        mm_free(q);
+    }
+    if ((q = mm_calloc(1, 1 << 20)) == NULL)
+        api_error("mm_calloc(1, 1 << 20) failed");
+    else {
+        for (i = 0; i < (1 << 20) && !q[i]; i++)
+            ;
+        if (i < (1 << 20))
+            api_error("mm_calloc(1, 1 << 20) byte %zu is not zero", i);
+        mm_free(q);
+    }
+    errno = 0;
+    if (mm_calloc(SIZE_MAX / 2, 4) != NULL || errno != ENOMEM)
+        api_error("mm_calloc did not fail with ENOMEM on overflow");
+}
+
+/* The three aligned allocators honour the alignment and reject bad ones */
+static void check_memalign(void)
+{
+    void *p[16];
+    size_t align;
+    int i, n = 0;
+
+    for (align = 16; align <= 4096; align *= 2) {
+        if ((p[n] = mm_memalign(align, 100 + align)) == NULL)
+            api_error("mm_memalign(%zu) failed", align);
+        else if (!ALIGNED(p[n], align))
+            api_error("mm_memalign(%zu) returned %p", align, p[n]);
+        else if (mm_usable_size(p[n]) < 100 + align)
+            api_error("mm_memalign(%zu) block is too small", align);
+        else
+            memset(p[n++], 0x5a, 100 + align);
+    }
+    if ((p[n] = mm_aligned_alloc(256, 512)) == NULL || !ALIGNED(p[n], 256))
+        api_error("mm_aligned_alloc(256, 512) returned %p", p[n]);
+    else
+        n++;
+    if (mm_posix_memalign(&p[n], 64, 1000) != 0 || !ALIGNED(p[n], 64))
+        api_error("mm_posix_memalign(64, 1000) failed");
+    else
+        n++;
+    if (mm_posix_memalign(&p[n], 24, 8) != EINVAL)
+        api_error("mm_posix_memalign(24, 8) did not return EINVAL");
+    errno = 0;
+    if (mm_memalign(48, 8) != NULL || errno != EINVAL)
+        api_error("mm_memalign(48, 8) did not fail with EINVAL");
+    for (i = 0; i < n; i++)
+        mm_free(p[i]);
+}
+
+/* mm_usable_size covers the request, all of which may be written */
+static void check_sizes(void)
+{
+    void *p;
+    size_t size, usable;
+
+    for (size = 1; size < 100000; size = size * 3 + 1) {
+        if ((p = mm_malloc(size)) == NULL) {
+            api_error("mm_malloc(%zu) failed", size);
+            continue;
+        }
+        if ((usable = mm_usable_size(p)) < size)
+            api_error("mm_usable_size is %zu for %zu bytes", usable, size);
+        else
+            memset(p, 0x5a, usable);
+        if (mm_heap_usable_size(NULL, p) != usable)
+            api_error("mm_heap_usable_size(NULL) differs from mm_usable_size");
+        mm_free_sized(p, size);
+    }
+}
+
+/* A batch is n distinct, aligned blocks that mm_free_batch takes back */
+static void check_batch(void)
+{
+    void *blocks[API_BLOCKS];
+    int i, j;
+
+    if (mm_malloc_batch(48, API_BLOCKS, blocks) != API_BLOCKS) {
+        api_error("mm_malloc_batch(48, %d) fell short", API_BLOCKS);
+        return;
+    }
+    for (i = 0; i < API_BLOCKS; i++) {
+        if (!ALIGNED(blocks[i], ALIGNMENT) || mm_usable_size(blocks[i]) < 48)
+            api_error("batch block %d at %p is not a 48-byte block", i, blocks[i]);
+        else
+            memset(blocks[i], i, 48);
+    }
+    for (i = 0; i < API_BLOCKS; i++)
+        for (j = 0; j < 48; j++)
+            if (((unsigned char *)blocks[i])[j] != i) {
+                api_error("batch block %d overlaps another", i);
+                break;
+            }
+    mm_free_batch(blocks, API_BLOCKS);
+}
+
+/* Region objects are 16-byte aligned, apart, and reusable after a reset */
+static void check_region(void)
+{
+    unsigned char *p[API_BLOCKS];
+    mm_region_t *r;
+    int i, j, round;
+
+    if ((r = mm_region_create(256)) == NULL) {
+        api_error("mm_region_create failed");
+        return;
+    }
+    for (round = 0; round < 2; round++) {
+        for (i = 0; i < API_BLOCKS; i++) {
+            if ((p[i] = mm_region_alloc(r, 1 + i * 7)) == NULL
+                    || !ALIGNED(p[i], 16)) {
+                api_error("mm_region_alloc(%d) returned %p", 1 + i * 7, p[i]);
+                mm_region_destroy(r);
+                return;
+            }
+            memset(p[i], i, 1 + i * 7);
+        }
+        for (i = 0; i < API_BLOCKS; i++)
+            for (j = 0; j < 1 + i * 7; j++)
+                if (p[i][j] != i) {
+                    api_error("region object %d overlaps another", i);
+                    break;
+                }
+        mm_region_reset(r);
+    }
+    mm_region_destroy(r);
+}
+
+/* A heap of its own keeps its blocks apart and passes its check */
+static void check_heap(void)
+{
+    mm_heap_t *h;
+    void *blocks[API_BLOCKS];
+    int i, n;
+
+    if ((h = mm_heap_create(1 << 20)) == NULL)
+        return;    /* the engine has no heaps besides the default one */
+    for (n = 0; n < API_BLOCKS; n++) {
+        if ((blocks[n] = mm_heap_malloc(h, 16 + n * 40)) == NULL) {
+            api_error("mm_heap_malloc(%d) failed", 16 + n * 40);
+            break;
+        }
+        if (mm_heap_usable_size(h, blocks[n]) < (size_t)(16 + n * 40))
+            api_error("mm_heap_usable_size is short for %d bytes", 16 + n * 40);
+        memset(blocks[n], 0x5a, 16 + n * 40);
+    }
+    for (i = 0; i < n; i += 2)
+        mm_heap_free(h, blocks[i]);
+    if (!mm_heap_check(h))
+        api_error("mm_heap_check failed");
+    for (i = 1; i < n; i += 2)
+        mm_heap_free(h, blocks[i]);
+    if (!mm_heap_check(h))
+        api_error("mm_heap_check failed once empty");
+    mm_heap_destroy(h);
+}
+
+/* Allocate API_BLOCKS blocks of growing size from heap h */
+static int alloc_blocks(mm_heap_t *h, void **blocks)
+{
+    int i;
+
+    for (i = 0; i < API_BLOCKS; i++)
+        if ((blocks[i] = mm_heap_malloc(h, 100 + i * 300)) == NULL) {
+            api_error("mm_heap_malloc(%d) failed", 100 + i * 300);
+            while (i--)
+                mm_heap_free(h, blocks[i]);
+            return 0;
+        }
+    return 1;
+}
+
+/*
+ * mm_heap_walk finds every live block the test holds, as allocated;
+ * the blocks it is still to see are left in blocks
+ */
+typedef struct {
+    mm_heap_t *heap;
+    void *blocks[API_BLOCKS];
+} walk_t;
+
+static int walk_block(void *ptr, size_t size, int allocated, void *ctx)
+{
+    walk_t *w = (walk_t *)ctx;
+    int i;
+
+    for (i = 0; i < API_BLOCKS; i++)
+        if (w->blocks[i] == ptr) {
+            if (!allocated || size < mm_heap_usable_size(w->heap, ptr))
+                return -1;
+            w->blocks[i] = NULL;
+        }
+    return 0;
+}
+
+/* Walk the default heap and one of its own with every third block freed */
+static void check_walk(void)
+{
+    void *blocks[API_BLOCKS];
+    walk_t w;
+    int i;
+
+    w.heap = NULL;
+    while (1) {
+        if (!alloc_blocks(w.heap, blocks))
+            break;
+        memcpy(w.blocks, blocks, sizeof(blocks));
+        for (i = 0; i < API_BLOCKS; i += 3) {
+            mm_heap_free(w.heap, blocks[i]);
+            w.blocks[i] = NULL;
+        }
+        if (mm_heap_walk(w.heap, walk_block, &w) != 0)
+            api_error("mm_heap_walk reported a block wrongly");
+        for (i = 0; i < API_BLOCKS; i++)
+            if (w.blocks[i])
+                api_error("mm_heap_walk missed block %d", i);
+        for (i = 0; i < API_BLOCKS; i++)
+            if (i % 3)
+                mm_heap_free(w.heap, blocks[i]);
+        if (w.heap || (w.heap = mm_heap_create(1 << 20)) == NULL)
+            break;
+    }
+    if (w.heap)
+        mm_heap_destroy(w.heap);
+}
+
+/* The free-space report of a heap with holes in it adds up */
+static void check_frag(void)
+{
+    void *blocks[API_BLOCKS];
+    struct mm_frag fr;
+    size_t sum;
+    int i;
+
+    if (!alloc_blocks(NULL, blocks))
+        return;
+    for (i = 0; i < API_BLOCKS; i += 3)
+        mm_free(blocks[i]);
+    mm_frag_report(&fr, 1);
+    for (i = 0, sum = 0; i < MM_FRAG_BUCKETS; i++)
+        sum += fr.histogram[i];
+    if (sum != fr.free_blocks || fr.largest_free > fr.free_bytes
+            || fr.free_bytes > fr.heap_bytes)
+        api_error("mm_frag_report does not add up");
+    for (i = 0; i < API_BLOCKS; i++)
+        if (i % 3)
+            mm_free(blocks[i]);
+}
+
+/* Every block mm_stats counts live is freed again, huge ones included */
+static void check_stats(void)
+{
+    void *blocks[API_BLOCKS], *huge;
+    struct mm_stats st;
+    size_t live;
+    int i;
+
+    if (!alloc_blocks(NULL, blocks))
+        return;
+    if ((huge = mm_malloc(1 << 20)) != NULL)
+        mm_free(huge);
+    for (i = 0; i < API_BLOCKS; i++)
+        mm_free(blocks[i]);
+    if (!mm_stats(&st))
+        return;    /* built without MM_STATS */
+    for (i = 0, live = st.huge_live_bytes; i < MM_STATS_CLASSES; i++)
+        live += st.live_blocks[i] + st.live_bytes[i];
+    for (i = 0; i < MM_STATS_SLAB_CLASSES; i++)
+        live += st.slab_live_blocks[i];
+    if (live || st.huge_allocs != st.huge_frees)
+        api_error("mm_stats counts blocks live on an empty heap");
+}
+
+/* mm_trim of an emptied heap does not grow it */
+static void check_trim(void)
+{
+    void *blocks[API_BLOCKS];
+    struct mm_frag fr;
+    size_t before;
+    int i;
+
+    if (!alloc_blocks(NULL, blocks))
+        return;
+    for (i = 0; i < API_BLOCKS; i++)
+        mm_free(blocks[i]);
+    mm_frag_report(&fr, 0);
+    before = fr.heap_bytes;
+    mm_trim(0);
+    mm_frag_report(&fr, 0);
+    if (fr.heap_bytes > before)
+        api_error("mm_trim grew the heap");
+}
+
+/*
+ * run_api_checks - Call the parts of mm.h the traces do not reach,
+ *    each on a fresh heap, and check the heap after each.
+ */
+static void run_api_checks(void)
+{
+    static const struct {
+        const char *name;
+        void (*check)(void);
+    } checks[] = {
+        {"calloc", check_calloc},
+        {"memalign", check_memalign},
+        {"usable_size", check_sizes},
+        {"batch", check_batch},
+        {"region", check_region},
+        {"heap", check_heap},
+        {"stats", check_stats},
+        {"frag", check_frag},
+        {"walk", check_walk},
+        {"trim", check_trim},
+    };
+    int i, before = errors;
+
+    for (i = 0; i < (int)(sizeof(checks) / sizeof(checks[0])); i++) {
+        if (verbose > 1)
+            printf("Checking %s\n", checks[i].name);
+        mem_reset_brk();
+        if (mm_init() < 0)
+            app_error("mm_init failed in run_api_checks");
+        checks[i].check();
+        if (!mm_check())
+            api_error("mm_check failed after the %s checks", checks[i].name);
+    }
+    if (verbose)
+        printf("API checks: %d errors\n\n", errors - before);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1287,6 +1741,35 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     va_end(ap);
 }
 
+/*
+ * api_error - Report an error found by run_api_checks
+ */
+void api_error(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+
+    errors++;
+
+    printf("ERROR [api checks]: ");
+    vprintf(fmt, ap);
+    putchar('\n');
+
+    va_end(ap);
+}
+
+/*
+ * print_frag - Report where the free space of the heap is, so that a
+ *     failed request can be told apart from an exhausted heap
+ */
+void print_frag(void)
+{
+    struct mm_frag fr;
+
+    mm_frag_report(&fr, 1);
+    mm_frag_print(stdout, &fr);
+}
+
 /*
  * usage - Explain the command line arguments
  */
@@ -1301,7 +1784,10 @@ static void usage(void)
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
-    fprintf(stderr, "\t-v <i>     Set verbosity level to <i> (default 1)\n");
+    fprintf(stderr, "\t-v <i>     Set verbosity level to <i> (default 1);\n");
+    fprintf(stderr, "\t           3 also reports the free space left by each trace.\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-b <n>     Also time batches of <n> blocks.\n");
+    fprintf(stderr, "\t-x         Also check the rest of mm.h, part by part.\n");
 }
@@ -11,47 +11,136 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 
 #include "csapp.h"
 #include "memlib.h"
 
-#define MAX_HEAP (20*(1<<20))  /* 20 MB */
-
 
 /* $begin memlib */
 /* Private global variables */
-static char *mem_heap;     /* Points to first byte of heap */ 
-static char *mem_brk;      /* Points to last byte of heap plus 1 */
-static char *mem_max_addr; /* Max legal heap addr plus 1*/ 
+static mem_region_t mem_default; /* the heap behind mem_sbrk */
 
 /* 
  * mem_init - Initialize the memory system model
  */
 void mem_init(void)
 {
-    mem_heap = (char *)Malloc(MAX_HEAP);
-    mem_brk = (char *)mem_heap;               
-    mem_max_addr = (char *)(mem_heap + MAX_HEAP); 
+    mem_region_init(&mem_default, Calloc(1, MAX_HEAP), MAX_HEAP);
 }
 
 /* 
  * mem_sbrk - Simple model of the sbrk function. Extends the heap 
  *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    this model, the heap is shrunk with mem_region_trim only. Not
+ *    thread-safe: a thread-safe allocator must only call it under
+ *    its own lock.
  */
 void *mem_sbrk(int incr) 
 {
-    char *old_brk = mem_brk;
+    return mem_region_sbrk(&mem_default, incr);
+}
+/* $end memlib */
+
+/*
+ * mem_region_init - Make [base, base + size) a region with an empty heap;
+ *    the memory must be zeroed, as from mem_map
+ */
+void mem_region_init(mem_region_t *r, void *base, size_t size)
+{
+    r->heap = (char *)base;
+    r->brk = (char *)base;
+    r->peak = (char *)base;
+    r->zero = (char *)base;
+    r->max_addr = (char *)base + size;
+}
+
+/*
+ * mem_region_sbrk - mem_sbrk for the heap of region r
+ */
+void *mem_region_sbrk(mem_region_t *r, int incr)
+{
+    char *old_brk = r->brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if ((incr < 0) || (incr > r->max_addr - r->brk)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
-    mem_brk += incr;
+    r->brk += incr;
+    if (r->brk > r->peak)
+        r->peak = r->brk;
+    if (r->brk > r->zero)
+        r->zero = r->brk;
     return (void *)old_brk;
 }
-/* $end memlib */
+
+/*
+ * mem_region_trim - Shrink the heap of region r by size bytes. Whole
+ *    pages given up are returned to the OS. MADV_FREE lets the kernel
+ *    reclaim them lazily, so a heap that regrows soon does not fault
+ *    every page in again; their contents are undefined afterwards.
+ *    Returns 0, or -1 if that would go below the heap start.
+ */
+int mem_region_trim(mem_region_t *r, size_t size)
+{
+    char *old_brk = r->brk;
+
+    if (size > (size_t)(r->brk - r->heap)) {
+        errno = EINVAL;
+        fprintf(stderr, "ERROR: mem_region_trim failed. Shrinking below the heap start...\n");
+        return -1;
+    }
+    r->brk -= size;
+    size_t page = mem_pagesize();
+    char *lo = (char *)(((uintptr_t)r->brk + page - 1) & ~(uintptr_t)(page - 1));
+    char *hi = (char *)((uintptr_t)old_brk & ~(uintptr_t)(page - 1));
+    if (lo < hi) {
+#ifdef MADV_FREE
+        if (madvise(lo, hi - lo, MADV_FREE) < 0)
+#endif
+            madvise(lo, hi - lo, MADV_DONTNEED);
+    }
+    return 0;
+}
+
+/*
+ * mem_region_reset - reset the brk pointer of region r to make an empty heap;
+ *    what the old heap used is no longer known to be zero
+ */
+void mem_region_reset(mem_region_t *r)
+{
+    r->brk = r->heap;
+    r->peak = r->heap;
+}
+
+/*
+ * mem_default_region - the region behind mem_sbrk and mem_heap_lo/hi
+ */
+mem_region_t *mem_default_region(void)
+{
+    return &mem_default;
+}
+
+/*
+ * mem_map - reserve size bytes of zeroed address space for more
+ *    regions; pages are only backed once touched. Returns NULL on
+ *    failure.
+ */
+void *mem_map(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
+/*
+ * mem_unmap - release a reservation made by mem_map
+ */
+void mem_unmap(void *p, size_t size)
+{
+    munmap(p, size);
+}
 
 /* 
  * mem_deinit - free the storage used by the memory system model
@@ -65,7 +154,7 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
-    mem_brk = (char *)mem_heap;
+    mem_region_reset(&mem_default);
 }
 
 /*
@@ -73,7 +162,7 @@ void mem_reset_brk()
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_heap;
+    return (void *)mem_default.heap;
 }
 
 /* 
@@ -81,7 +170,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return (void *)(mem_default.brk - 1);
 }
 
 /*
@@ -89,7 +178,17 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)((void *)mem_brk - (void *)mem_heap);
+    return (size_t)((void *)mem_default.brk - (void *)mem_default.heap);
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since
+ *    the last mem_reset_brk; it differs from mem_heapsize once the
+ *    heap has been shrunk
+ */
+size_t mem_peak_heapsize()
+{
+    return (size_t)((void *)mem_default.peak - (void *)mem_default.heap);
 }
 
 /*
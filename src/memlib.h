@@ -1,6 +1,9 @@
 /* $begin memlibheader */
 #include <unistd.h>
 
+/* Size of the simulated heap; must agree with MAX_HEAP in config.h */
+#define MAX_HEAP (20*(1<<20))  /* 20 MB */
+
 void mem_init(void);               
 void *mem_sbrk(int incr);
 
@@ -9,6 +12,24 @@ void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
+
+/* A simulated heap of its own, for allocators that manage several */
+typedef struct mem_region_t {
+    char *heap;     /* first byte of the region */
+    char *brk;      /* last byte of its heap plus 1 */
+    char *peak;     /* highest brk since the last reset */
+    char *zero;     /* bytes from here on were never handed out, still zero */
+    char *max_addr; /* max legal heap addr plus 1 */
+} mem_region_t;
+
+void mem_region_init(mem_region_t *r, void *base, size_t size);
+void *mem_region_sbrk(mem_region_t *r, int incr);
+int mem_region_trim(mem_region_t *r, size_t size);
+void mem_region_reset(mem_region_t *r);
+mem_region_t *mem_default_region(void);
+void *mem_map(size_t size);
+void mem_unmap(void *p, size_t size);
 /* $end memlibheader */
 
@@ -4,10 +4,16 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdint.h>
+#include <errno.h>
+#include <limits.h>
 
 #include "mm.h"
 #include "memlib.h"
 
+#ifdef MM_THREAD_SAFE
+#include <pthread.h>
+#endif
+
 /*************************************************************************
  * Basic Constants and Macros
  * You are not required to use these macros but may find them helpful.
@@ -27,9 +33,50 @@
 #define GET(p) (*(uintptr_t *)(p))
 #define PUT(p, val) (*(uintptr_t *)(p) = (val))
 
+/*
+ * Header bit 1 records whether the previous block is allocated.
+ * Allocated blocks carry no footer, so a block's footer may only be
+ * read (PREV_BLKP) when this bit says the previous block is free.
+ */
+#define PREV_ALLOC (0x2)
+
+/*
+ * Header bit 2 marks a huge block that huge_alloc mapped on its own,
+ * outside every arena. Its size field holds the length of the mapping.
+ */
+#define MMAPPED (0x4)
+
+/*
+ * Header bit 3 marks a free block of fresh memory from memlib: its
+ * payload is zero except for its first ZERO_DIRTY bytes, which hold the
+ * list or tree links, and its footer. mm_calloc only clears those.
+ */
+#define ZERO (0x8)
+#define ZERO_DIRTY (2 * DSIZE)
+
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p) (GET(p) & ~(DSIZE - 1))
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+#define GET_MMAPPED(p) (GET(p) & MMAPPED)
+#define GET_ZERO(p) (GET(p) & ZERO)
+
+/*
+ * Set or clear the previous-allocated bit of the header at p.
+ * In thread-safe mode the owner of an allocated block reads its header
+ * without the heap lock while a neighbour's malloc/free may flip this
+ * bit, so both sides use atomic accesses.
+ */
+#ifdef MM_THREAD_SAFE
+#define SET_PREV_ALLOC(p) __atomic_fetch_or((uintptr_t *)(p), PREV_ALLOC, __ATOMIC_RELAXED)
+#define CLR_PREV_ALLOC(p) \
+        __atomic_fetch_and((uintptr_t *)(p), ~(uintptr_t)PREV_ALLOC, __ATOMIC_RELAXED)
+#define GET_OWN_SIZE(p) (__atomic_load_n((uintptr_t *)(p), __ATOMIC_RELAXED) & ~(DSIZE - 1))
+#else
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(p) PUT(p, GET(p) & ~(uintptr_t)PREV_ALLOC)
+#define GET_OWN_SIZE(p) GET_SIZE(p)
+#endif
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp) ((char *)(bp) - WSIZE)
@@ -39,22 +86,302 @@
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/* Block size for a request: header plus payload, aligned, at least
+   large enough to hold the free-list links and footer once freed */
+#define ADJUSTED_SIZE(size) (((size) + WSIZE <= 2 * DSIZE) ? \
+        2 * DSIZE : DSIZE * (((size) + WSIZE + (DSIZE - 1)) / DSIZE))
+
+/*
+ * Defaults for MM_OPT_MMAP_THRESHOLD and MM_OPT_TRIM_THRESHOLD. Pages
+ * given back by a trim fault in again when the heap regrows, so only
+ * a top block twice as large as the largest heap request is trimmed.
+ */
+#define MMAP_THRESHOLD (1 << 20)
+#define TRIM_THRESHOLD (2 * MMAP_THRESHOLD)
+/* Free bytes an automatic trim leaves at the top of the heap */
+#define TOP_PAD (1 << 17)
+
+/* Defaults for MM_OPT_GROW_MIN, MM_OPT_GROW_SHIFT and MM_OPT_GROW_MAX */
+#define GROW_MIN CHUNKSIZE
+#define GROW_SHIFT (6)
+#define GROW_MAX (1 << 20)
+
 #define NUM_SIZE_CLASSES (10)
 #define HASH_DIFF (7)
+/* The last, unbounded class is kept in a size-ordered tree */
+#define LARGE_CLASS (NUM_SIZE_CLASSES - 1)
+
+/* Sizes up to SMALL_CLASS_MAX are mapped through small_class_table */
+#define SMALL_CLASS_MAX (1 << 10)
+#define SMALL_CLASS_SLOTS (SMALL_CLASS_MAX / DSIZE + 1)
+
+/*
+ * Requests of at most SLAB_MAX bytes are served from slabs: SLAB_SIZE
+ * aligned pages, each carved into headerless slots of one size class
+ * (16, 32, ..., SLAB_MAX bytes). slab_pagemap has one bit per heap page
+ * and tells mm_free whether a pointer lies in a slab.
+ * The compact layout (MM_COMPACT) steps the classes by WSIZE instead,
+ * so small objects are only WSIZE aligned but lose no space to rounding:
+ * an 8 or 24 byte node takes 8 or 24 bytes.
+ */
+#define SLAB_SIZE (1 << 12)
+#define SLAB_MAX (128)
+#ifdef MM_COMPACT
+#define SLAB_GRAIN WSIZE
+#else
+#define SLAB_GRAIN DSIZE
+#endif
+#define NUM_SLAB_CLASSES (SLAB_MAX / SLAB_GRAIN)
+#define SLAB_CLASS(size) (((size) - 1) / SLAB_GRAIN)
+#define SLAB_SLOT_SIZE(klass) (((klass) + 1) * SLAB_GRAIN)
+#define SLAB_PAGES (MAX_HEAP / SLAB_SIZE + 1)
+#define SLAB_PAGE_INDEX(a, p) \
+        ((uintptr_t)(p) / SLAB_SIZE - (uintptr_t)(a)->region->heap / SLAB_SIZE)
+
+/* The page map is read without the arena lock in thread-safe mode */
+#define PAGEMAP_LOAD(a, i) __atomic_load_n(&(a)->slab_pagemap[i], __ATOMIC_RELAXED)
+#define PAGEMAP_OR(a, i, v) __atomic_fetch_or(&(a)->slab_pagemap[i], (v), __ATOMIC_RELAXED)
+#define PAGEMAP_AND(a, i, v) __atomic_fetch_and(&(a)->slab_pagemap[i], (v), __ATOMIC_RELAXED)
+
+/*
+ * Freed blocks of FAST_MIN .. FAST_MAX bytes go to LIFO fast bins of
+ * their arena, one bin per DSIZE step, without being coalesced. They
+ * stay marked allocated, so their neighbours never merge with them, and
+ * malloc_block hands them out again as they are. fast_consolidate frees
+ * them for real when a request finds no fit, and when a free leaves a
+ * block of FAST_CONSOLIDATE bytes or more behind.
+ */
+#define FAST_MIN ADJUSTED_SIZE(SLAB_MAX + 1)
+#define FAST_MAX (512)
+#define NUM_FASTBINS ((FAST_MAX - FAST_MIN) / DSIZE + 1)
+#define FASTBIN(asize) (((asize) - FAST_MIN) / DSIZE)
+#define FAST_CONSOLIDATE (1 << 16)
+
+#ifdef MM_THREAD_SAFE
+/*
+ * Thread-safe mode: the heap is split into NUM_ARENAS arenas, each
+ * with its own lock, lists and memlib region. Threads are assigned to
+ * arenas round-robin on their first allocation and a block is always
+ * freed back into the arena it came from. A thread freeing a block of
+ * another arena does not take that arena's lock: it pushes the block
+ * onto the arena's remote_frees stack with a CAS, and whoever next
+ * allocates from the arena under its lock takes the whole stack with
+ * one exchange and frees it.
+ */
+#ifndef MM_NUM_ARENAS
+#define MM_NUM_ARENAS (8)
+#endif
+#define NUM_ARENAS (MM_NUM_ARENAS)
+
+/*
+ * Every thread also keeps a cache of allocated-but-unused blocks of
+ * its own arena in front of it.
+ * Cache bins hold slab slots (one bin per slab class) and ordinary
+ * blocks of exactly 144 .. TCACHE_MAX_SIZE bytes (one bin per DSIZE
+ * step). A bin that runs dry is refilled, and a full bin is drained,
+ * TCACHE_BATCH blocks at a time under a single lock acquisition.
+ */
+#define TCACHE_MAX_SIZE (1 << 10)
+#define TCACHE_MIN_BLOCK ADJUSTED_SIZE(SLAB_MAX + 1)
+#define TCACHE_BINS (NUM_SLAB_CLASSES + (TCACHE_MAX_SIZE - TCACHE_MIN_BLOCK) / DSIZE + 1)
+#define TCACHE_BLOCK_BIN(asize) (NUM_SLAB_CLASSES + ((asize) - TCACHE_MIN_BLOCK) / DSIZE)
+#define TCACHE_FILL (16)
+#define TCACHE_BATCH (TCACHE_FILL / 2)
+
+#define ARENA_LOCK(a) pthread_mutex_lock(&(a)->lock)
+#define ARENA_UNLOCK(a) pthread_mutex_unlock(&(a)->lock)
+#define HUGE_LOCK() pthread_mutex_lock(&huge_lock)
+#define HUGE_UNLOCK() pthread_mutex_unlock(&huge_lock)
+#else
+#define NUM_ARENAS (1)
+#define ARENA_LOCK(a)
+#define ARENA_UNLOCK(a)
+#define HUGE_LOCK()
+#define HUGE_UNLOCK()
+#endif
+
+/* Number of bits needed to represent x (x > 0), i.e. floor(log2(x)) + 1 */
+#define BIT_WIDTH(x) ((int)(8 * sizeof(unsigned long)) - __builtin_clzl(x))
 
 #define INVALID_ADDR ("[ERROR] mm_check() fails: free chunk has invalid address\n")
 #define NONFREE_IN_SEGLIST ("[ERROR] mm_check() fails: non-free chunk appears in free list\n")
 #define FREE_NOT_IN_SEGLIST ("[ERROR] mm_check() fails: free chunk not found in free list\n")
-
-static size_t heap_size = 0;
-void* heap_listp = NULL;
+#define BAD_SEGLIST_BITMAP ("[ERROR] mm_check() fails: size class bitmap disagrees with seg lists\n")
+#define BAD_BOUNDARY_TAGS ("[ERROR] mm_check() fails: free chunk header and footer disagree\n")
+#define BAD_PREV_ALLOC ("[ERROR] mm_check() fails: prev-alloc bit disagrees with previous chunk\n")
+#define BAD_SLAB ("[ERROR] mm_check() fails: slab on partial list is full or unmapped\n")
+#define WRONG_SEGLIST ("[ERROR] mm_check() fails: free chunk stored in the wrong size class\n")
+#define BAD_FASTBIN ("[ERROR] mm_check() fails: fast bin holds a free or mis-sized chunk\n")
+#define BAD_LARGE_TREE ("[ERROR] mm_check() fails: large-block tree is out of order or unbalanced\n")
+#define BAD_FREE_SIZE ("[ERROR] mm_free_sized() fails: size does not fit the block\n")
+#define BAD_ZERO_CHUNK ("[ERROR] mm_check() fails: chunk marked zero holds non-zero bytes\n")
+#define LISTED_TWICE ("[ERROR] mm_check() fails: chunk appears twice in the seg lists\n")
+#define LISTED_NOT_CHUNK ("[ERROR] mm_check() fails: seg list entry is not a free chunk of the heap\n")
+#define UNCOALESCED ("[ERROR] mm_check() fails: adjacent free chunks were not coalesced\n")
 
 typedef struct block_t {
     struct block_t* prev;
     struct block_t* next;
 } block_s;
 
-block_s* segfit_lists[NUM_SIZE_CLASSES];
+/*
+ * Free blocks of LARGE_CLASS are nodes of an AVL tree ordered by
+ * (size, address) instead of a list, so find_fit gets the best fit in
+ * logarithmic time. Keys are unique since no two blocks share an address.
+ */
+typedef struct tree_t {
+    struct tree_t* left;
+    struct tree_t* right;
+    long height;
+} tree_s;
+
+/* Huge blocks are kept on a list for mm_heap_walk, linked through the
+   words before their offset word */
+typedef struct huge_t {
+    struct huge_t* prev;
+    struct huge_t* next;
+} huge_s;
+
+#define HUGE_NODE(bp) ((huge_s *)((char *)(bp) - DSIZE) - 1)
+#define HUGE_PAYLOAD(m) ((char *)((m) + 1) + DSIZE)
+
+#define TREE_HEIGHT(t) ((t) ? (t)->height : 0)
+
+_Static_assert(sizeof(tree_s) <= ZERO_DIRTY && sizeof(block_s) <= ZERO_DIRTY,
+               "the links of a free block must fit in ZERO_DIRTY");
+
+_Static_assert(NUM_SIZE_CLASSES <= 8 * sizeof(unsigned int),
+               "segfit_bitmap needs one bit per size class");
+static unsigned char small_class_table[SMALL_CLASS_SLOTS];
+static size_t mmap_threshold = MMAP_THRESHOLD;
+static size_t trim_threshold = TRIM_THRESHOLD;
+static size_t grow_min = GROW_MIN;
+static size_t grow_shift = GROW_SHIFT;
+static size_t grow_max = GROW_MAX;
+
+/* A slab header sits at the start of its page, slots follow it */
+typedef struct slab_t {
+    struct slab_t* prev;    /* partial list of its class */
+    struct slab_t* next;
+    void* free_slots;       /* LIFO of freed slots, linked through them */
+    unsigned short klass;
+    unsigned short used;    /* slots currently handed out */
+    unsigned short bump;    /* slots from here on were never handed out */
+    unsigned short nslots;
+} slab_s;
+
+#define SLAB_HDR_SIZE (DSIZE * ((sizeof(slab_s) + DSIZE - 1) / DSIZE))
+
+/*
+ * An arena is a heap of its own: a memlib region with a prologue and
+ * an epilogue, the segregated lists of its free blocks and its slabs.
+ * Arena 0 lives in the default memlib region; the others are carved
+ * MAX_HEAP apart out of arena_space, which is mapped on first use.
+ */
+typedef struct arena_t {
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_t lock;
+    void* remote_frees;         /* blocks freed by other arenas' threads */
+#endif
+    mem_region_t* region;
+    char* heap_listp;           /* NULL until the arena is initialized */
+    size_t heap_size;           /* for mm_check() */
+    block_s* segfit_lists[NUM_SIZE_CLASSES]; /* LARGE_CLASS stays empty */
+    tree_s* large_root;         /* free blocks of LARGE_CLASS */
+    unsigned int segfit_bitmap; /* bit i is set iff class i is non-empty */
+    slab_s* slab_partial[NUM_SLAB_CLASSES]; /* slabs with a free slot, per class */
+    void* fastbins[NUM_FASTBINS]; /* linked through the first payload word */
+    int have_fast;              /* some fast bin may be non-empty */
+    uint64_t slab_pagemap[(SLAB_PAGES + 63) / 64];
+    uint64_t* check_marks;      /* mm_check's side bitmap, kept zeroed between calls */
+    size_t check_len;           /* bytes mapped for it */
+} arena_s;
+
+/* A heap handle is an arena of its own, at the start of its mapping */
+struct mm_heap {
+    arena_s arena;
+    mem_region_t region;
+    size_t length;              /* of the mapping */
+};
+
+/*
+ * Counters for mm_stats, kept only when built with MM_STATS; otherwise
+ * every STAT_ macro compiles to nothing. In thread-safe mode each thread
+ * counts in a node of its own, so no two threads write the same cache
+ * line, and mm_stats adds the nodes up. A node outlives its thread and
+ * is taken over, counts and all, by the next thread that needs one.
+ */
+_Static_assert(NUM_SIZE_CLASSES == MM_STATS_CLASSES, "mm_stats needs one slot per size class");
+_Static_assert(NUM_SLAB_CLASSES <= MM_STATS_SLAB_CLASSES, "mm_stats needs one slot per slab class");
+
+#ifdef MM_STATS
+#ifdef MM_THREAD_SAFE
+typedef struct stats_node_t {
+    struct mm_stats st;         /* only written by the owning thread */
+    struct stats_node_t* next;  /* on stats_nodes, never unlinked */
+    int used;                   /* owned by a live thread */
+} stats_node_s;
+
+/* stats_spare is also the shared fallback when no node can be mapped */
+static stats_node_s stats_spare;
+static stats_node_s* stats_nodes = &stats_spare;
+static __thread stats_node_s* stats_mine = NULL;
+static pthread_key_t stats_key;
+static pthread_once_t stats_key_once = PTHREAD_ONCE_INIT;
+static stats_node_s* stats_get(void);
+/* a plain add made visible to mm_stats, as only the owner writes */
+#define STAT_ADD(field, n) do { \
+        size_t* f_ = &(stats_mine ? stats_mine : stats_get())->st.field; \
+        __atomic_store_n(f_, *f_ + (size_t)(n), __ATOMIC_RELAXED); \
+    } while (0)
+#else
+static struct mm_stats stats;
+#define STAT_ADD(field, n) (stats.field += (size_t)(n))
+#endif
+#define STAT_ALLOC(a, bp) stats_block(a, bp, 1)
+#define STAT_FREE(a, bp) stats_block(a, bp, -1)
+#else
+#define STAT_ADD(field, n)
+#define STAT_ALLOC(a, bp)
+#define STAT_FREE(a, bp)
+#endif
+
+/* What kind of block stats_kind found */
+#define STAT_HUGE 0
+#define STAT_SLAB 1
+#define STAT_HEAP 2
+
+static huge_s* huge_list = NULL;
+
+#ifdef MM_THREAD_SAFE
+static pthread_mutex_t huge_lock = PTHREAD_MUTEX_INITIALIZER;
+static arena_s arenas[NUM_ARENAS] = {
+    [0 ... NUM_ARENAS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+static mem_region_t arena_regions[NUM_ARENAS];
+static char* arena_space = NULL;
+static pthread_once_t arena_space_once = PTHREAD_ONCE_INIT;
+/* next arena handed to a thread */
+static unsigned int arena_next = 0;
+
+/* Cached blocks stay allocated in their arena and are linked through
+   their first payload word */
+typedef struct tcache_t {
+    void* bins[TCACHE_BINS];
+    unsigned short count[TCACHE_BINS];
+    arena_s* arena;        /* the thread's arena, NULL until assigned */
+    unsigned int gen;      /* heap_gen the cached blocks belong to */
+    int registered;        /* exit destructor installed */
+} tcache_s;
+
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+/* bumped by mm_init, invalidates every thread's cache */
+static unsigned int heap_gen = 0;
+static __thread tcache_s tcache;
+#else
+static arena_s arenas[NUM_ARENAS];
+#endif
 /*
 0: <= 128 (2^7)
 1: 129-256 (2^8)
@@ -65,34 +392,137 @@ block_s* segfit_lists[NUM_SIZE_CLASSES];
 6: 4097-8192 (2^13)
 7: 8193-16384 (2^14)
 8: 16385-32768 (2^15)
-9: >= 32769
+9: >= 32769 (tree)
 */
 
-static int mm_alloc_correct(void);
-static int mm_free_in_seglist(void);
-static int mm_valid_free_address(void);
+static int mm_alloc_correct(arena_s*);
+static int mm_boundary_tags(arena_s*);
+static int mm_free_in_seglist(arena_s*);
+static uint64_t* check_bitmap(arena_s*);
+static int seglist_mark(arena_s*, uint64_t*, void*, size_t*);
+static int tree_mark(arena_s*, uint64_t*, tree_s*, size_t*);
 static int segfit_asize2index(size_t);
-static void segfit_insert(block_s*);
-static void segfit_remove(block_s*);
+static int segfit_asize2index_slow(size_t);
+static void segfit_insert(arena_s*, block_s*);
+static void segfit_remove(arena_s*, block_s*);
+static tree_s* tree_insert(tree_s*, tree_s*);
+static tree_s* tree_remove(tree_s*, tree_s*);
+static tree_s* tree_best_fit(tree_s*, size_t);
+static long tree_check(tree_s*);
+static void* coalesce(arena_s*, void*);
+static void* extend_heap(arena_s*, size_t);
+static void* heap_grow(arena_s*, size_t);
+static void* find_fit(arena_s*, size_t);
+static void place(arena_s*, void*, size_t);
+static void* malloc_block(arena_s*, size_t, int);
+static size_t malloc_blocks(arena_s*, size_t, size_t, void**);
+static size_t zero_merge(void*, void*);
+static void free_block(arena_s*, void*);
+static int fast_consolidate(arena_s*);
+static int mm_fastbins_correct(arena_s*);
+static int grow_block(arena_s*, void*, size_t);
+static int heap_trim(arena_s*, size_t);
+static void* alloc_aligned(arena_s*, size_t, size_t);
+static int slab_contains(arena_s*, void*);
+static void* slab_alloc(arena_s*, size_t);
+static void slab_free(arena_s*, void*);
+static void slab_destroy(arena_s*, slab_s*);
+static void slab_release_empty(arena_s*);
+static int mm_slab_correct(arena_s*);
+static int arena_init(arena_s*);
+static int arena_check(arena_s*);
+static void* realloc_block(void*, size_t);
+static size_t usable_size(arena_s*, void*);
+#ifdef MM_STATS
+static void stats_reset(void);
+static int stats_kind(arena_s*, void*, size_t*);
+static void stats_live(int, size_t, long);
+static void stats_block(arena_s*, void*, long);
+#endif
+static void stats_tree(tree_s*, struct mm_stats*);
+static void frag_add(struct mm_frag*, int, size_t);
+static void frag_tree(tree_s*, struct mm_frag*);
+static int arena_walk(arena_s*, mm_walk_fn, void*);
+static int slab_walk(slab_s*, mm_walk_fn, void*);
+static int fast_marked(arena_s*, uint64_t*, void*);
+static arena_s* arena_of(void*);
+static arena_s* thread_arena(void);
+static void* heap_malloc(arena_s*, size_t);
+static void heap_free(arena_s*, void*);
+static int huge_contains(arena_s*, void*);
+static void* huge_alloc(size_t, size_t);
+static void huge_free(void*);
+static void* huge_realloc(void*, size_t);
+#ifdef MM_THREAD_SAFE
+static int tcache_bin(size_t);
+static void* tcache_alloc(int, size_t);
+static int tcache_free(arena_s*, void*);
+static tcache_s* tcache_get(void);
+static void tcache_flush(tcache_s*);
+static void remote_push(arena_s*, void*);
+static void remote_drain(arena_s*);
+#endif
 
 /**********************************************************
  * mm_init
  * Initialize the heap, including "allocation" of the
- * prologue and epilogue
+ * prologue and epilogue of arena 0. The other arenas are
+ * emptied and set up again when a thread first uses them.
+ * In thread-safe mode no other thread may be inside the
+ * allocator; blocks cached by threads are discarded
  **********************************************************/
 int mm_init(void) {
-    if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1)
+    for (int i = 0; i < SMALL_CLASS_SLOTS; ++i) {
+        small_class_table[i] = segfit_asize2index_slow(i * DSIZE);
+    }
+    arenas[0].region = mem_default_region();
+#ifdef MM_STATS
+    stats_reset();
+#endif
+    /* huge blocks of the old heap are gone with it */
+    while (huge_list) {
+        huge_free(HUGE_PAYLOAD(huge_list));
+    }
+#ifdef MM_THREAD_SAFE
+    for (int i = 0; i < NUM_ARENAS; ++i) {
+        arenas[i].remote_frees = NULL;
+    }
+#endif
+    for (int i = 1; i < NUM_ARENAS; ++i) {
+        arenas[i].heap_listp = NULL;
+        if (arenas[i].region) {
+            mem_region_reset(arenas[i].region);
+        }
+    }
+#ifdef MM_THREAD_SAFE
+    __atomic_add_fetch(&heap_gen, 1, __ATOMIC_RELEASE);
+#endif
+    return arena_init(&arenas[0]);
+}
+
+/**********************************************************
+ * arena_init
+ * Lay out the prologue and epilogue at the start of the
+ * arena's region and empty its lists
+ **********************************************************/
+static int arena_init(arena_s* a) {
+    char* heap_listp;
+
+    if ((heap_listp = mem_region_sbrk(a->region, 4 * WSIZE)) == (void *)-1)
         return -1;
-    heap_size += 4 * WSIZE;                        // for mm_check()
+    a->heap_size = 4 * WSIZE;                      // for mm_check()
     PUT(heap_listp, 0);                            // alignment padding
     PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1)); // prologue header
     PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); // prologue footer
-    PUT(heap_listp + (3 * WSIZE), PACK(0, 1));     // epilogue header
-    heap_listp += DSIZE;
-    /* cannot initialize globally, otherwise segfault */
-    for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
-        segfit_lists[i] = NULL;
-    }
+    PUT(heap_listp + (3 * WSIZE), PACK(0, 1 | PREV_ALLOC)); // epilogue header
+    a->heap_listp = heap_listp + DSIZE;
+    memset(a->segfit_lists, 0, sizeof(a->segfit_lists));
+    a->large_root = NULL;
+    a->segfit_bitmap = 0;
+    memset(a->slab_partial, 0, sizeof(a->slab_partial));
+    memset(a->slab_pagemap, 0, sizeof(a->slab_pagemap));
+    memset(a->fastbins, 0, sizeof(a->fastbins));
+    a->have_fast = 0;
     return 0;
 }
 
@@ -103,33 +533,63 @@ int mm_init(void) {
  * - the next block is available for coalescing
  * - the previous block is available for coalescing
  * - both neighbours are available for coalescing
+ * bp must already carry a free header and footer. The
+ * block following the result is marked as having a free
+ * predecessor.
  **********************************************************/
-void* coalesce(void *bp) {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+static void* coalesce(arena_s* a, void *bp) {
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
+    void* prev = prev_alloc ? NULL : PREV_BLKP(bp);
+    void* next = NEXT_BLKP(bp);
+    size_t zero;
     if (prev_alloc && next_alloc) { /* Case 1 */
-        return bp;
+        STAT_ADD(coalesces[0], 1);
     } else if (prev_alloc && !next_alloc) { /* Case 2 */
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        segfit_remove((block_s *)NEXT_BLKP(bp));
-        PUT(HDRP(bp), PACK(size, 0));
+        STAT_ADD(coalesces[1], 1);
+        size += GET_SIZE(HDRP(next));
+        segfit_remove(a, (block_s *)next);
+        zero = zero_merge(bp, next);
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC | zero));
         PUT(FTRP(bp), PACK(size, 0));
-        return bp;
     } else if (!prev_alloc && next_alloc) { /* Case 3 */
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-        segfit_remove((block_s *)PREV_BLKP(bp));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        return PREV_BLKP(bp);
+        STAT_ADD(coalesces[2], 1);
+        size += GET_SIZE(HDRP(prev));
+        segfit_remove(a, (block_s *)prev);
+        zero = zero_merge(prev, bp);
+        PUT(HDRP(prev), PACK(size, PREV_ALLOC | zero));
+        PUT(FTRP(prev), PACK(size, 0));
+        bp = prev;
     } else { /* Case 4 */
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
-        segfit_remove((block_s *)PREV_BLKP(bp));
-        segfit_remove((block_s *)NEXT_BLKP(bp));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
-        return PREV_BLKP(bp);
+        STAT_ADD(coalesces[3], 1);
+        size += GET_SIZE(HDRP(prev)) + GET_SIZE(HDRP(next));
+        segfit_remove(a, (block_s *)prev);
+        segfit_remove(a, (block_s *)next);
+        zero = zero_merge(bp, next);
+        zero &= zero_merge(prev, bp);
+        PUT(HDRP(prev), PACK(size, PREV_ALLOC | zero));
+        PUT(FTRP(prev), PACK(size, 0));
+        bp = prev;
+    }
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    return bp;
+}
+
+/*
+ * Before free blocks lp and rp = NEXT_BLKP(lp) merge: if both are zero,
+ * clear what lies between their payloads and return ZERO for the merged
+ * block, otherwise return 0. rp must be off its list already, and its
+ * header and lp's footer are gone afterwards.
+ */
+static size_t zero_merge(void* lp, void* rp) {
+    if (!GET_ZERO(HDRP(lp)) || !GET_ZERO(HDRP(rp))) {
+        return 0;
     }
+    /* lp's footer, rp's header and rp's links */
+    char* end = MIN((char *)rp + ZERO_DIRTY, FTRP(rp));
+    memset(HDRP(rp) - WSIZE, 0, end - (HDRP(rp) - WSIZE));
+    return ZERO;
 }
 
 /**********************************************************
@@ -138,22 +598,57 @@ void* coalesce(void *bp) {
  * requirements of course. Free the former epilogue block
  * and reallocate its new header
  **********************************************************/
-void* extend_heap(size_t words) {
+static void* extend_heap(arena_s* a, size_t words) {
     char *bp;
     size_t size;
 
+    /* mem_region_sbrk takes an int */
+    if (words > INT_MAX / WSIZE - 1) {
+        errno = ENOMEM;
+        return NULL;
+    }
     /* Allocate an even number of words to maintain alignments */
     size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
     // printf("[extend_heap] looking for %ld bytes\n", size);
-    if ((bp = mem_sbrk(size)) == (void *)-1)
+    /* memory memlib never handed out before is still zero */
+    size_t zero = (a->region->brk == a->region->zero) ? ZERO : 0;
+    if ((bp = mem_region_sbrk(a->region, size)) == (void *)-1)
         return NULL;
-    heap_size += size;                    // for mm_check()
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         // free block header
+    a->heap_size += size;                 // for mm_check()
+    STAT_ADD(extends, 1);
+    STAT_ADD(extend_bytes, size);
+    /* Initialize free block header/footer and the epilogue header,
+       the former epilogue knows whether the last block is allocated */
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | zero)); // free block header
     PUT(FTRP(bp), PACK(size, 0));         // free block footer
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); // new epilogue header
     /* Coalesce if the previous block was free */
-    return coalesce(bp);
+    return coalesce(a, bp);
+}
+
+/**********************************************************
+ * heap_grow
+ * Extend the heap so that its top block is free and holds
+ * at least asize bytes, and return that block, which is on
+ * no list. Only the shortfall over a free top block is
+ * needed, but the heap grows by at least grow_min bytes or
+ * by heap_size >> grow_shift, up to grow_max, so that
+ * sustained growth needs geometrically fewer extensions.
+ **********************************************************/
+static void* heap_grow(arena_s* a, size_t asize) {
+    char* epilogue = a->region->brk - WSIZE;
+    size_t top = GET_PREV_ALLOC(epilogue) ? 0 : GET_SIZE(epilogue - WSIZE);
+    size_t need = asize > top ? asize - top : DSIZE;
+    size_t step = MIN(MAX(grow_min, a->heap_size >> grow_shift), grow_max);
+    void* bp;
+
+    step = DSIZE * ((step + DSIZE - 1) / DSIZE);
+    /* stay within the region, so that only a real shortage reports */
+    step = MIN(step, (size_t)(a->region->max_addr - a->region->brk) & ~(size_t)(DSIZE - 1));
+    if (step > need && (bp = extend_heap(a, step / WSIZE)) != NULL) {
+        return bp;
+    }
+    return extend_heap(a, need / WSIZE);
 }
 
 /**********************************************************
@@ -161,29 +656,30 @@ void* extend_heap(size_t words) {
  * Traverse the heap searching for a block to fit asize
  * Return NULL if no free blocks can handle that size
  * Assumed that asize is aligned
+ * Lists are searched first fit, the large-block tree best fit
+ * The block is taken off its list; place() splits it
  **********************************************************/
-void* find_fit(size_t asize) {
-    int i, start = segfit_asize2index(asize);
-    for (i = start; i < NUM_SIZE_CLASSES; ++i) {
-        block_s* head = segfit_lists[i];
-        if (!head) {
-            continue;
+static void* find_fit(arena_s* a, size_t asize) {
+    int start = segfit_asize2index(asize);
+    /* only visit non-empty classes, lowest first */
+    unsigned int candidates = a->segfit_bitmap & (~0u << start);
+    while (candidates) {
+        int i = __builtin_ctz(candidates);
+        candidates &= candidates - 1;
+        if (i == LARGE_CLASS) {
+            tree_s* fit = tree_best_fit(a->large_root, asize);
+            if (fit) {
+                segfit_remove(a, (block_s *)fit);
+            }
+            return fit;
         }
+        block_s* head = a->segfit_lists[i];
         block_s* curr = head;
         //while (1) {  do-while is faster (might be because of fewer branch predictions?)
         do {
             size_t csize = GET_SIZE(HDRP((void *)curr));
             if (asize <= csize) {
-                segfit_remove(curr);
-                size_t diff = csize - asize;
-                if (diff >= asize /*2 * DSIZE*/) {
-                    PUT(HDRP(curr), PACK(asize, 0));
-                    PUT(HDRP(curr), PACK(asize, 0));
-                    void* rp = (void *)curr + asize;
-                    PUT(HDRP(rp), PACK(diff, 0));
-                    PUT(FTRP(rp), PACK(diff, 0));
-                    segfit_insert((block_s *)rp);
-                }
+                segfit_remove(a, curr);
                 return (void *)curr;
             }
             curr = curr->next;
@@ -198,200 +694,1753 @@ void* find_fit(size_t asize) {
 /**********************************************************
  * place
  * Mark the block as allocated
+ * Allocated blocks get no footer; the next block learns
+ * about the allocation through its prev-alloc bit
+ * The block at the top of the heap is always split, so
+ * that what heap_grow added beyond asize stays free
  **********************************************************/
-void place(void *bp, size_t asize) {
+static void place(arena_s* a, void *bp, size_t asize) {
     size_t bsize = GET_SIZE(HDRP(bp));
     size_t rsize = bsize - asize;
-    if (rsize >= asize) {
-        /* split if free chunk is too large */
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    if (rsize >= asize
+            || (rsize >= 2 * DSIZE && GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0)) {
+        /* split if free chunk is too large; bp's links spill into
+           rp's links at most, so rp stays zero if bp was */
         void* rp = bp + asize;
-        PUT(HDRP(rp), PACK(rsize, 0));
+        STAT_ADD(splits, 1);
+        PUT(HDRP(rp), PACK(rsize, PREV_ALLOC | GET_ZERO(HDRP(bp))));
         PUT(FTRP(rp), PACK(rsize, 0));
-        segfit_insert((block_s *)rp);
-        PUT(HDRP(bp), PACK(asize, 1));
-        PUT(FTRP(bp), PACK(asize, 1));
+        segfit_insert(a, (block_s *)rp);
+        PUT(HDRP(bp), PACK(asize, 1 | prev_alloc));
     } else {
-        PUT(HDRP(bp), PACK(bsize, 1));
-        PUT(FTRP(bp), PACK(bsize, 1));
+        PUT(HDRP(bp), PACK(bsize, 1 | prev_alloc));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
     }
     // assert(mm_check());
 
 }
 
+/**********************************************************
+ * alloc_aligned
+ * Allocate a block of asize bytes whose payload is aligned
+ * to align (a power of two, at least 2 * DSIZE). The slack
+ * in front of the payload becomes a free block of its own
+ * and so does any usable tail.
+ **********************************************************/
+static void* alloc_aligned(arena_s* a, size_t align, size_t asize) {
+    /* room to move the payload to an aligned address that
+       leaves a leading block of at least 2 * DSIZE */
+    size_t req = asize + align + 2 * DSIZE;
+    char *bp, *ap;
+
+    if ((bp = find_fit(a, req)) == NULL && fast_consolidate(a)) {
+        bp = find_fit(a, req);
+    }
+    if (!bp) {
+        /* grow the top block just enough for an aligned payload */
+        char* epilogue = a->region->brk - WSIZE;
+        char* top = GET_PREV_ALLOC(epilogue) ? a->region->brk
+                                             : epilogue + WSIZE - GET_SIZE(epilogue - WSIZE);
+        ap = (char *)(((uintptr_t)top + align - 1) & ~(uintptr_t)(align - 1));
+        if (ap != top && ap - top < 2 * DSIZE) {
+            ap += align;
+        }
+        if ((bp = heap_grow(a, (ap - top) + asize)) == NULL) {
+            return NULL;
+        }
+    }
+    size_t bsize = GET_SIZE(HDRP(bp));
+    ap = (char *)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+    if (ap != bp && ap - bp < 2 * DSIZE) {
+        ap += align;
+    }
+    if (ap != bp) {
+        /* the block before bp is allocated, nothing to coalesce */
+        size_t lead = ap - bp;
+        STAT_ADD(splits, 1);
+        PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(lead, 0));
+        segfit_insert(a, (block_s *)bp);
+        bsize -= lead;
+    }
+    size_t rsize = bsize - asize;
+    if (rsize >= 2 * DSIZE) {
+        /* the block after the original one is allocated too */
+        STAT_ADD(splits, 1);
+        PUT(HDRP(ap), PACK(asize, 1 | (ap == bp ? GET_PREV_ALLOC(HDRP(bp)) : 0)));
+        void* rp = NEXT_BLKP(ap);
+        PUT(HDRP(rp), PACK(rsize, PREV_ALLOC));
+        PUT(FTRP(rp), PACK(rsize, 0));
+        segfit_insert(a, (block_s *)rp);
+    } else {
+        PUT(HDRP(ap), PACK(bsize, 1 | (ap == bp ? GET_PREV_ALLOC(HDRP(bp)) : 0)));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(ap)));
+    }
+    return ap;
+}
+
 /**********************************************************
  * mm_free
- * Free the block and coalesce with neighbouring blocks
+ * Huge blocks are unmapped. Blocks of another thread's
+ * arena go on that arena's remote free stack. Otherwise
+ * park the block in the thread cache if it has room, or
+ * free it under the arena lock
  **********************************************************/
 void mm_free(void *bp) {
     if (bp == NULL) return;
+    arena_s* a = arena_of(bp);
+    STAT_FREE(a, bp);
+    if (huge_contains(a, bp)) {
+        huge_free(bp);
+        return;
+    }
+#ifdef MM_THREAD_SAFE
+    if (a != thread_arena()) {
+        remote_push(a, bp);
+        return;
+    }
+    if (tcache_free(a, bp)) {
+        return;
+    }
+#endif
+    ARENA_LOCK(a);
+    heap_free(a, bp);
+    ARENA_UNLOCK(a);
+}
+
+/**********************************************************
+ * mm_free_sized
+ * Free a block whose requested size the caller knows. The
+ * heap still reads the header to coalesce, so the size is
+ * only checked, and only in MM_DEBUG builds
+ **********************************************************/
+void mm_free_sized(void *bp, size_t size) {
+#ifdef MM_DEBUG
+    if (bp != NULL && size > mm_usable_size(bp)) {
+        fprintf(stderr, BAD_FREE_SIZE);
+        abort();
+    }
+#else
+    (void)size;
+#endif
+    mm_free(bp);
+}
+
+/**********************************************************
+ * mm_usable_size
+ * Number of bytes the caller may use at bp, which can be
+ * more than it asked for; 0 for NULL. Only for blocks of
+ * the default heap, see mm_heap_usable_size
+ **********************************************************/
+size_t mm_usable_size(void *bp) {
+    if (bp == NULL) {
+        return 0;
+    }
+    return usable_size(arena_of(bp), bp);
+}
+
+/* mm_usable_size for bp, an allocated block of arena a */
+static size_t usable_size(arena_s* a, void* bp) {
+    if (huge_contains(a, bp)) {
+        return GET_SIZE(HDRP(bp)) - GET((char *)bp - DSIZE);
+    }
+    if (slab_contains(a, bp)) {
+        slab_s* slab = (slab_s *)((uintptr_t)bp & ~(uintptr_t)(SLAB_SIZE - 1));
+        return SLAB_SLOT_SIZE(slab->klass);
+    }
+    /* allocated blocks have no footer */
+    return GET_OWN_SIZE(HDRP(bp)) - WSIZE;
+}
+
+/**********************************************************
+ * heap_free
+ * Return slab slots to their slab, fast-bin sizes to their
+ * fast bin and everything else to the segregated lists.
+ * Caller holds the arena lock.
+ **********************************************************/
+static void heap_free(arena_s* a, void *bp) {
+    if (slab_contains(a, bp)) {
+        slab_free(a, bp);
+        return;
+    }
+    size_t asize = GET_SIZE(HDRP(bp));
+    /* blocks shrunk by mm_realloc can be smaller than FAST_MIN */
+    if (asize >= FAST_MIN && asize <= FAST_MAX) {
+        int bin = FASTBIN(asize);
+        *(void **)bp = a->fastbins[bin];
+        a->fastbins[bin] = bp;
+        a->have_fast = 1;
+        return;
+    }
+    free_block(a, bp);
+}
+
+/**********************************************************
+ * free_block
+ * Free the block and coalesce with neighbouring blocks
+ * A result of at least trim_threshold bytes at the top of
+ * the heap is given back to memlib, all but TOP_PAD bytes;
+ * one of at least FAST_CONSOLIDATE bytes empties the fast
+ * bins
+ **********************************************************/
+static void free_block(arena_s* a, void *bp) {
     size_t size = GET_SIZE(HDRP(bp));
-    PUT(HDRP(bp), PACK(size, 0));
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
     PUT(FTRP(bp), PACK(size, 0));
-    block_s* coal_bp = (block_s *)coalesce(bp);
-    segfit_insert(coal_bp);
+    block_s* coal_bp = (block_s *)coalesce(a, bp);
+    segfit_insert(a, coal_bp);
+    size = GET_SIZE(HDRP(coal_bp));
+    if (size >= trim_threshold && GET_SIZE(HDRP(NEXT_BLKP(coal_bp))) == 0) {
+        heap_trim(a, TOP_PAD);
+    }
+    if (size >= FAST_CONSOLIDATE && a->have_fast) {
+        fast_consolidate(a);
+    }
     // assert(mm_check());
 }
 
+/**********************************************************
+ * fast_consolidate
+ * Free every block parked in the fast bins for real, so
+ * that it coalesces with its neighbours. Returns 1 if there
+ * was anything to free.
+ **********************************************************/
+static int fast_consolidate(arena_s* a) {
+    if (!a->have_fast) {
+        return 0;
+    }
+    a->have_fast = 0;
+    for (int i = 0; i < NUM_FASTBINS; i++) {
+        void* bp = a->fastbins[i];
+        a->fastbins[i] = NULL;
+        while (bp) {
+            void* next = *(void **)bp;
+            free_block(a, bp);
+            bp = next;
+        }
+    }
+    return 1;
+}
+
+/**********************************************************
+ * heap_trim
+ * Shrink the heap so that at most pad bytes of the free
+ * block at its top remain. Returns 1 if the heap shrank.
+ * Caller holds the arena lock.
+ **********************************************************/
+static int heap_trim(arena_s* a, size_t pad) {
+    if (!a->heap_listp) {
+        return 0;
+    }
+    char* epilogue = a->region->brk - WSIZE;
+    if (GET_PREV_ALLOC(epilogue)) {
+        return 0;
+    }
+    size_t size = GET_SIZE(epilogue - WSIZE);  // footer of the top block
+    void* bp = epilogue + WSIZE - size;
+    /* what is kept must be 0 or a valid free block */
+    size_t keep = pad ? MAX(DSIZE * ((pad + DSIZE - 1) / DSIZE), 2 * DSIZE) : 0;
+    if (keep >= size) {
+        return 0;
+    }
+    size_t release = size - keep;
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    segfit_remove(a, (block_s *)bp);
+    mem_region_trim(a->region, release);
+    a->heap_size -= release;
+    STAT_ADD(trims, 1);
+    STAT_ADD(trim_bytes, release);
+    if (keep) {
+        PUT(HDRP(bp), PACK(keep, prev_alloc));
+        PUT(FTRP(bp), PACK(keep, 0));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); // new epilogue header
+        segfit_insert(a, (block_s *)bp);
+    } else {
+        PUT(HDRP(bp), PACK(0, 1 | prev_alloc)); // new epilogue header
+    }
+    return 1;
+}
+
+/**********************************************************
+ * mm_trim
+ * Give back all but pad bytes of the free space at the top
+ * of every arena's heap, after turning fast-bin blocks and
+ * empty slabs back into free space. The calling thread's cache is emptied
+ * first. Returns 1 if any heap shrank.
+ **********************************************************/
+int mm_trim(size_t pad) {
+    int trimmed = 0;
+#ifdef MM_THREAD_SAFE
+    tcache_s* tc = tcache_get();
+#endif
+    for (int i = 0; i < NUM_ARENAS; i++) {
+        arena_s* a = &arenas[i];
+        ARENA_LOCK(a);
+        if (a->heap_listp) {
+            size_t heap_size = a->heap_size;
+#ifdef MM_THREAD_SAFE
+            remote_drain(a);
+            if (tc->arena == a) {
+                tcache_flush(tc);
+            }
+#endif
+            fast_consolidate(a);
+            slab_release_empty(a);
+            heap_trim(a, pad);
+            trimmed |= a->heap_size < heap_size;
+        }
+        ARENA_UNLOCK(a);
+    }
+    return trimmed;
+}
+
 /**********************************************************
  * mm_malloc
  * Allocate a block of size bytes.
- * The type of search is determined by find_fit
- * The decision of splitting the block, or not is determined
- *   in place(..)
- * If no block satisfies the request, the heap is extended
+ * Requests of at least mmap_threshold bytes get a mapping
+ * of their own, as long as one can be had.
+ * Cacheable sizes come from the thread cache; the rest
+ * are allocated under the lock of the thread's arena
  **********************************************************/
 void* mm_malloc(size_t size) {
-    size_t asize;      /* adjusted block size */
-    size_t extendsize; /* amount to extend heap if no fit */
-    char *bp;
+    arena_s* a;
+    void* bp;
 
     /* Ignore spurious requests */
     if (size == 0) {
         return NULL;
     }
-    /* Adjust block size to include overhead and alignment reqs. */
-    asize = (size <= DSIZE) ?
-            2 * DSIZE : DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
-
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize);
-        // assert(mm_check());
+    if (size >= mmap_threshold && (bp = huge_alloc(DSIZE, size)) != NULL) {
+        STAT_ALLOC(NULL, bp);
         return bp;
     }
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize / WSIZE)) == NULL) {
-        // assert(mm_check());
+    /* only a mapping of its own could hold more than a heap */
+    if (size > MAX_HEAP) {
+        errno = ENOMEM;
         return NULL;
     }
-    place(bp, asize);
-    // assert(mm_check());
+#ifdef MM_THREAD_SAFE
+    int bin = tcache_bin(size);
+    if (bin >= 0) {
+        bp = tcache_alloc(bin, size);
+        STAT_ALLOC(NULL, bp);
+        return bp;
+    }
+#endif
+    a = thread_arena();
+    ARENA_LOCK(a);
+    bp = heap_malloc(a, size);
+    ARENA_UNLOCK(a);
+    STAT_ALLOC(a, bp);
     return bp;
 }
 
 /**********************************************************
- * mm_realloc
- * Implemented simply in terms of mm_malloc and mm_free
- *********************************************************/
-void *mm_realloc(void *ptr, size_t size) {
-    /* If size == 0 then this is just free, and we return NULL. */
-    if (size == 0) {
-        mm_free(ptr);
-        // assert(mm_check());
+ * mm_calloc
+ * Allocate a zeroed array of nmemb elements of size bytes.
+ * Huge requests are fresh mappings and already zero; a heap
+ * block cut from memory memlib never handed out before is
+ * only cleared where the allocator wrote to it
+ **********************************************************/
+void* mm_calloc(size_t nmemb, size_t size) {
+    arena_s* a;
+    void* bp;
+    size_t bytes;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+        errno = ENOMEM;
         return NULL;
     }
-    /* If oldptr is NULL, then this is just malloc. */
-    if (ptr == NULL) {
-        return mm_malloc(size);
+    if (bytes == 0) {
+        return NULL;
     }
-    /* need to compute size of chunk to include overhead and alignment */
-    size_t new_asize = (size <= DSIZE) ?
-            2 * DSIZE : DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
-    size_t old_asize = GET_SIZE(HDRP(ptr));
-    if (new_asize == old_asize) {
-        /* no need to malloc and copy, just return the old one */
-        return ptr;
-    } else if (new_asize < old_asize) {
-        /* no need to malloc a new chunk, just chop the old one */
-        size_t rsize = old_asize - new_asize;
-        if (rsize >= new_asize) {
-            PUT(HDRP(ptr), PACK(new_asize, 1));
-            PUT(FTRP(ptr), PACK(new_asize, 1));
-            void* rp = ptr + new_asize;
-            PUT(HDRP(rp), PACK(rsize, 0));
-            PUT(FTRP(rp), PACK(rsize, 0));
-            segfit_insert(rp);
-            // assert(mm_check());
-        }
-        return ptr;
-    } else {
-        void* oldptr = ptr;
-        void* newptr = mm_malloc(size);
-        if (!newptr) {
-            return NULL;
+    if (bytes >= mmap_threshold && (bp = huge_alloc(DSIZE, bytes)) != NULL) {
+        STAT_ALLOC(NULL, bp);
+        return bp;
+    }
+    /* only a mapping of its own could hold more than a heap */
+    if (bytes > MAX_HEAP) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (bytes <= SLAB_MAX) {
+        if ((bp = mm_malloc(bytes)) != NULL) {
+            memset(bp, 0, bytes);
         }
-        memcpy(newptr, oldptr, size);
-        mm_free(oldptr);
-        // assert(mm_check());
-        return newptr;
+        return bp;
     }
+    a = thread_arena();
+    ARENA_LOCK(a);
+    bp = NULL;
+    if (a->heap_listp || arena_init(a) == 0) {
+#ifdef MM_THREAD_SAFE
+        remote_drain(a);
+#endif
+        bp = malloc_block(a, ADJUSTED_SIZE(bytes), 1);
+    }
+    ARENA_UNLOCK(a);
+    STAT_ALLOC(a, bp);
+    return bp;
 }
 
 /**********************************************************
- * mm_check
- * Check the consistency of the memory heap
- * Return nonzero if the heap is consistant.
- *********************************************************/
-int mm_check(void) {
-    return mm_alloc_correct()       // checks all chunks in seg lists are free
-        && mm_free_in_seglist()     // checks all free chunks in heap are added to seg list
-        && mm_valid_free_address(); // checks all free chunks' addresses are within heap
-}
-
-/**********************************************************
- * HELPER FUNCTIONS
- * * segfit helpers
- * * memory check helpers
- *********************************************************/
+ * mm_malloc_batch
+ * Allocate n blocks of size bytes into out[0..n) under a
+ * single lock. Returns how many were allocated; on a short
+ * count the caller still owns those blocks
+ **********************************************************/
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+    size_t i = 0;
 
-static int segfit_asize2index(size_t asize) {
-    if (asize <= PW2(HASH_DIFF)) {
+    if (size == 0) {
         return 0;
-    } else {
-        int index = HASH_DIFF;
-        while (PW2(index) < asize) {
-            index++;
+    }
+    if (size >= mmap_threshold) {
+        /* a mapping each, nothing to share */
+        while (i < n && (out[i] = mm_malloc(size)) != NULL) {
+            i++;
         }
-        return MIN((index - HASH_DIFF), (NUM_SIZE_CLASSES - 1));
+        return i;
     }
-}
-
-static void segfit_remove(block_s* bp) {
-    size_t bp_asize = GET_SIZE(HDRP((void *)bp));
-    int bp_index = segfit_asize2index(bp_asize);
-    if (bp->next == bp) {
-        segfit_lists[bp_index] = NULL;
-    } else {
-        bp->prev->next = bp->next;
-        bp->next->prev = bp->prev;
-        if (segfit_lists[bp_index] == bp) {
-            segfit_lists[bp_index] = bp->next;
+    /* only a mapping of its own could hold more than a heap */
+    if (size > MAX_HEAP) {
+        errno = ENOMEM;
+        return 0;
+    }
+    arena_s* a = thread_arena();
+    ARENA_LOCK(a);
+    if (a->heap_listp || arena_init(a) == 0) {
+#ifdef MM_THREAD_SAFE
+        remote_drain(a);
+#endif
+        if (size <= SLAB_MAX) {
+            while (i < n && (out[i] = slab_alloc(a, size)) != NULL) {
+                i++;
+            }
+        } else {
+            i = malloc_blocks(a, ADJUSTED_SIZE(size), n, out);
         }
     }
-}
-
-static void segfit_insert(block_s* bp) {
-    size_t bp_asize = GET_SIZE(HDRP((void *)bp));
-    int bp_index = segfit_asize2index(bp_asize);
-    if (!segfit_lists[bp_index]) {
-        segfit_lists[bp_index] = bp;
-        segfit_lists[bp_index]->next = segfit_lists[bp_index];
-        segfit_lists[bp_index]->prev = segfit_lists[bp_index];
-    } else {
-        bp->next = (block_s *)segfit_lists[bp_index];
-        bp->prev = ((block_s *)segfit_lists[bp_index])->prev;
-        bp->prev->next = (block_s *)bp;
-        bp->next->prev = (block_s *)bp;
+    ARENA_UNLOCK(a);
+#ifdef MM_STATS
+    for (size_t j = 0; j < i; j++) {
+        STAT_ALLOC(a, out[j]);
     }
+#endif
+    return i;
 }
 
 /**********************************************************
- * mm_alloc_correct
- * Checks whether the chunks in seg list are actually free
- *********************************************************/
-static int mm_alloc_correct(void) {
-    for (int i = 0; i < NUM_SIZE_CLASSES; i++) {
-        block_s* head = segfit_lists[i];
-        if (!head) {
+ * mm_free_batch
+ * Free the n blocks in ptrs[] (NULLs are skipped), taking
+ * the arena lock once for all blocks of the thread's arena
+ **********************************************************/
+void mm_free_batch(void **ptrs, size_t n) {
+    arena_s* locked = NULL;
+#ifdef MM_THREAD_SAFE
+    arena_s* own = thread_arena();
+#endif
+
+    for (size_t i = 0; i < n; i++) {
+        void* bp = ptrs[i];
+        if (bp == NULL) {
             continue;
         }
-        block_s* curr = head;
+        arena_s* a = arena_of(bp);
+        STAT_FREE(a, bp);
+        if (huge_contains(a, bp)) {
+            huge_free(bp);
+            continue;
+        }
+#ifdef MM_THREAD_SAFE
+        if (a != own) {
+            remote_push(a, bp);
+            continue;
+        }
+#endif
+        if (!locked) {
+            locked = a;
+            ARENA_LOCK(a);
+        }
+        heap_free(a, bp);
+    }
+    if (locked) {
+        ARENA_UNLOCK(locked);
+    }
+}
+
+/**********************************************************
+ * heap_malloc
+ * Small requests are served by slab_alloc, the rest by
+ * malloc_block. Caller holds the arena lock.
+ **********************************************************/
+static void* heap_malloc(arena_s* a, size_t size) {
+    if (!a->heap_listp && arena_init(a) < 0) {
+        return NULL;
+    }
+#ifdef MM_THREAD_SAFE
+    remote_drain(a);
+#endif
+    if (size <= SLAB_MAX) {
+        return slab_alloc(a, size);
+    }
+    /* Adjust block size to include overhead and alignment reqs. */
+    return malloc_block(a, ADJUSTED_SIZE(size), 0);
+}
+
+/**********************************************************
+ * malloc_block
+ * Allocate a block of asize bytes from the seg lists.
+ * The type of search is determined by find_fit
+ * The decision of splitting the block, or not is determined
+ *   in place(..)
+ * If no block satisfies the request, the heap is extended
+ * With clear set the payload is zeroed, which for a block
+ *   of fresh memory means just its first bytes
+ **********************************************************/
+static void* malloc_block(arena_s* a, size_t asize, int clear) {
+    char *bp;
+
+    /* Reuse a fast-bin block of exactly this size */
+    if (asize <= FAST_MAX && asize >= FAST_MIN && a->fastbins[FASTBIN(asize)]) {
+        bp = a->fastbins[FASTBIN(asize)];
+        a->fastbins[FASTBIN(asize)] = *(void **)bp;
+        if (clear) {
+            memset(bp, 0, asize - WSIZE);
+        }
+        return bp;
+    }
+    /* Search the free list for a fit, then again once the
+       fast bins have been merged back */
+    if ((bp = find_fit(a, asize)) == NULL
+            && (!fast_consolidate(a) || (bp = find_fit(a, asize)) == NULL)) {
+        /* No fit found. Get more memory and place the block */
+        if ((bp = heap_grow(a, asize)) == NULL) {
+            // assert(mm_check());
+            return NULL;
+        }
+    }
+    size_t zero = GET_ZERO(HDRP(bp));
+    place(a, bp, asize);
+    if (clear) {
+        size_t payload = GET_SIZE(HDRP(bp)) - WSIZE;
+        if (zero) {
+            /* the links and, unless bp was split, the old footer */
+            memset(bp, 0, MIN(ZERO_DIRTY, payload));
+            PUT(FTRP(bp), 0);
+        } else {
+            memset(bp, 0, payload);
+        }
+    }
+    // assert(mm_check());
+    return bp;
+}
+
+/**********************************************************
+ * malloc_blocks
+ * Allocate n blocks of asize bytes into out[], recycling
+ * fast-bin blocks of that size first and carving the rest
+ * side by side out of one free block, which needs a single
+ * search and split. Falls back to malloc_block per block
+ * when no block is large enough. Returns how many blocks
+ * were allocated. Caller holds the arena lock.
+ **********************************************************/
+static size_t malloc_blocks(arena_s* a, size_t asize, size_t n, void** out) {
+    size_t i = 0;
+    char *bp;
+
+    if (asize >= FAST_MIN && asize <= FAST_MAX) {
+        void** bin = &a->fastbins[FASTBIN(asize)];
+        while (i < n && *bin) {
+            out[i++] = *bin;
+            *bin = *(void **)*bin;
+        }
+    }
+    if (i < n && n - i <= MAX_HEAP / asize) {
+        size_t need = (n - i) * asize;
+        /* no speculative growth the region cannot hold, it would report
+           running out of memory while single blocks still fit */
+        if ((bp = find_fit(a, need)) != NULL
+                || ((size_t)(a->region->max_addr - a->region->brk) >= need
+                    && (bp = heap_grow(a, need)) != NULL)) {
+            /* allocate it as one block, then cut that into n - i */
+            size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+            place(a, bp, need);
+            size_t left = GET_SIZE(HDRP(bp));
+            for (; i < n - 1; i++) {
+                PUT(HDRP(bp), PACK(asize, 1 | prev_alloc));
+                out[i] = bp;
+                bp += asize;
+                left -= asize;
+                prev_alloc = PREV_ALLOC;
+            }
+            /* the last one keeps whatever place() did not split off */
+            PUT(HDRP(bp), PACK(left, 1 | prev_alloc));
+            out[i++] = bp;
+        }
+    }
+    while (i < n && (out[i] = malloc_block(a, asize, 0)) != NULL) {
+        i++;
+    }
+    // assert(mm_check());
+    return i;
+}
+
+/**********************************************************
+ * mm_realloc
+ * Shrinks in place; grows in place into a free successor
+ * or past the end of the heap, otherwise moves the block
+ * with mm_malloc and mm_free
+ * A slab slot stays put as long as the new size fits it,
+ * so does a huge block
+ *********************************************************/
+void *mm_realloc(void *ptr, size_t size) {
+#ifdef MM_STATS
+    STAT_ADD(reallocs, 1);
+    if (ptr && size) {
+        size_t old_size;
+        int old_kind = stats_kind(NULL, ptr, &old_size);
+        void* newptr = realloc_block(ptr, size);
+        if (newptr == ptr) {
+            /* resized in place, unseen by mm_malloc and mm_free */
+            stats_live(old_kind, old_size, -1);
+            old_kind = stats_kind(NULL, ptr, &old_size);
+            stats_live(old_kind, old_size, 1);
+        }
+        return newptr;
+    }
+#endif
+    return realloc_block(ptr, size);
+}
+
+/* The work of mm_realloc, which only adds the statistics */
+static void* realloc_block(void *ptr, size_t size) {
+    /* If size == 0 then this is just free, and we return NULL. */
+    if (size == 0) {
+        mm_free(ptr);
+        // assert(mm_check());
+        return NULL;
+    }
+    /* If oldptr is NULL, then this is just malloc. */
+    if (ptr == NULL) {
+        return mm_malloc(size);
+    }
+    arena_s* a = arena_of(ptr);
+    if (huge_contains(a, ptr)) {
+        return huge_realloc(ptr, size);
+    }
+    if (slab_contains(a, ptr)) {
+        slab_s* slab = (slab_s *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+        size_t slot_size = SLAB_SLOT_SIZE(slab->klass);
+        if (size <= slot_size) {
+            return ptr;
+        }
+        void* newptr = mm_malloc(size);
+        if (!newptr) {
+            return NULL;
+        }
+        memcpy(newptr, ptr, slot_size);
+        mm_free(ptr);
+        return newptr;
+    }
+    size_t old_asize = GET_OWN_SIZE(HDRP(ptr));
+    if (size > MAX_HEAP) {
+        /* only a mapping of its own can hold it, so the block moves */
+        void* newptr = mm_malloc(size);
+        if (!newptr) {
+            return NULL;
+        }
+        memcpy(newptr, ptr, old_asize - WSIZE);
+        mm_free(ptr);
+        return newptr;
+    }
+    /* need to compute size of chunk to include overhead and alignment */
+    size_t new_asize = ADJUSTED_SIZE(size);
+    if (new_asize == old_asize) {
+        /* no need to malloc and copy, just return the old one */
+        return ptr;
+    } else if (new_asize < old_asize) {
+        /* no need to malloc a new chunk, just chop the old one */
+        size_t rsize = old_asize - new_asize;
+        if (rsize >= new_asize) {
+            ARENA_LOCK(a);
+            STAT_ADD(splits, 1);
+            PUT(HDRP(ptr), PACK(new_asize, 1 | GET_PREV_ALLOC(HDRP(ptr))));
+            void* rp = ptr + new_asize;
+            PUT(HDRP(rp), PACK(rsize, PREV_ALLOC));
+            PUT(FTRP(rp), PACK(rsize, 0));
+            segfit_insert(a, coalesce(a, rp));
+            ARENA_UNLOCK(a);
+            // assert(mm_check());
+        }
+        return ptr;
+    } else {
+        /* grow in place if the heap allows it, copy as a last resort */
+        ARENA_LOCK(a);
+        int grown = grow_block(a, ptr, new_asize);
+        ARENA_UNLOCK(a);
+        if (grown) {
+            // assert(mm_check());
+            return ptr;
+        }
+        void* oldptr = ptr;
+        void* newptr = mm_malloc(size);
+        if (!newptr) {
+            return NULL;
+        }
+        /* the old payload is everything after the header */
+        memcpy(newptr, oldptr, MIN(size, old_asize - WSIZE));
+        mm_free(oldptr);
+        // assert(mm_check());
+        return newptr;
+    }
+}
+
+/**********************************************************
+ * mm_memalign
+ * Allocate a block of size bytes whose payload is aligned
+ * to alignment, a power of two. The slack in front of the
+ * payload is split off as a free block, so the result is an
+ * ordinary block for mm_free and mm_realloc
+ **********************************************************/
+void* mm_memalign(size_t alignment, size_t size) {
+    arena_s* a;
+    void* bp;
+
+    if (alignment == 0 || (alignment & (alignment - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    /* every payload is DSIZE aligned, except slab slots of a compact
+       build; those are too once their size is a multiple of DSIZE */
+    if (alignment <= DSIZE) {
+        if (size > SIZE_MAX - (DSIZE - 1)) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        return mm_malloc((size + DSIZE - 1) & ~(DSIZE - 1));
+    }
+    if (size == 0) {
+        return NULL;
+    }
+    /* an alignment beyond the heap size is only found in a mapping */
+    if ((size >= mmap_threshold || alignment > MAX_HEAP)
+            && (bp = huge_alloc(alignment, size)) != NULL) {
+        STAT_ALLOC(NULL, bp);
+        return bp;
+    }
+    if (size > MAX_HEAP || alignment > MAX_HEAP) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    a = thread_arena();
+    ARENA_LOCK(a);
+    bp = NULL;
+    if (a->heap_listp || arena_init(a) == 0) {
+#ifdef MM_THREAD_SAFE
+        remote_drain(a);
+#endif
+        bp = alloc_aligned(a, alignment, ADJUSTED_SIZE(size));
+    }
+    ARENA_UNLOCK(a);
+    if (!bp) {
+        errno = ENOMEM;
+    }
+    STAT_ALLOC(a, bp);
+    return bp;
+}
+
+/**********************************************************
+ * mm_aligned_alloc
+ * C11 aligned_alloc on top of mm_memalign
+ **********************************************************/
+void* mm_aligned_alloc(size_t alignment, size_t size) {
+    return mm_memalign(alignment, size);
+}
+
+/**********************************************************
+ * mm_posix_memalign
+ * POSIX posix_memalign: alignment must also be a multiple
+ * of sizeof(void *). Returns 0, EINVAL or ENOMEM and leaves
+ * *memptr alone on failure
+ **********************************************************/
+int mm_posix_memalign(void** memptr, size_t alignment, size_t size) {
+    if (alignment == 0 || alignment % sizeof(void *)
+            || (alignment & (alignment - 1))) {
+        return EINVAL;
+    }
+    void* bp = mm_memalign(alignment, size);
+    if (!bp && size) {
+        return ENOMEM;
+    }
+    *memptr = bp;
+    return 0;
+}
+
+/**********************************************************
+ * mm_heap_create
+ * Make a heap of its own, able to grow to size bytes
+ * (MAX_HEAP if size is 0 or larger). The heap lives in one
+ * mapping together with its arena, so destroying it takes
+ * a single unmap. Its blocks never leave that mapping, huge
+ * ones included, are not cached per thread, and must be
+ * freed with mm_heap_free
+ **********************************************************/
+mm_heap_t* mm_heap_create(size_t size) {
+    size_t page = mem_pagesize();
+    size_t hdr = (sizeof(mm_heap_t) + page - 1) / page * page;
+
+    if (size == 0 || size > MAX_HEAP) {
+        size = MAX_HEAP;
+    }
+    size = (size + page - 1) / page * page;
+    /* zeroed, so every list starts out empty */
+    char* p = mem_map(hdr + size);
+    if (!p) {
+        return NULL;
+    }
+    mm_heap_t* h = (mm_heap_t *)p;
+    h->length = hdr + size;
+    mem_region_init(&h->region, p + hdr, size);
+    h->arena.region = &h->region;
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_init(&h->arena.lock, NULL);
+#endif
+    if (arena_init(&h->arena) < 0) {
+        mm_heap_destroy(h);
+        return NULL;
+    }
+    return h;
+}
+
+/**********************************************************
+ * mm_heap_malloc
+ * mm_malloc from heap h; a NULL h is the default heap
+ **********************************************************/
+void* mm_heap_malloc(mm_heap_t* h, size_t size) {
+    if (!h) {
+        return mm_malloc(size);
+    }
+    if (size == 0 || size > (size_t)(h->region.max_addr - h->region.heap)) {
+        return NULL;
+    }
+    ARENA_LOCK(&h->arena);
+    void* bp = heap_malloc(&h->arena, size);
+    ARENA_UNLOCK(&h->arena);
+    STAT_ALLOC(&h->arena, bp);
+    return bp;
+}
+
+/**********************************************************
+ * mm_heap_free
+ * Free a block that mm_heap_malloc took from heap h
+ **********************************************************/
+void mm_heap_free(mm_heap_t* h, void* bp) {
+    if (!h) {
+        mm_free(bp);
+        return;
+    }
+    if (bp == NULL) return;
+    STAT_FREE(&h->arena, bp);
+    ARENA_LOCK(&h->arena);
+    heap_free(&h->arena, bp);
+    ARENA_UNLOCK(&h->arena);
+}
+
+/**********************************************************
+ * mm_heap_destroy
+ * Throw heap h away with every block still in it
+ **********************************************************/
+void mm_heap_destroy(mm_heap_t* h) {
+    if (!h) {
+        return;
+    }
+#ifdef MM_THREAD_SAFE
+    pthread_mutex_destroy(&h->arena.lock);
+#endif
+    if (h->arena.check_marks) {
+        mem_unmap(h->arena.check_marks, h->arena.check_len);
+    }
+    mem_unmap(h, h->length);
+}
+
+/**********************************************************
+ * mm_heap_check
+ * mm_check for heap h; a NULL h is the default heap
+ **********************************************************/
+int mm_heap_check(mm_heap_t* h) {
+    return h ? arena_check(&h->arena) : mm_check();
+}
+
+/**********************************************************
+ * mm_heap_usable_size
+ * mm_usable_size for a block of heap h; a NULL h is the
+ * default heap
+ **********************************************************/
+size_t mm_heap_usable_size(mm_heap_t* h, void* bp) {
+    if (!h) {
+        return mm_usable_size(bp);
+    }
+    return bp ? usable_size(&h->arena, bp) : 0;
+}
+
+/**********************************************************
+ * mm_heap_walk
+ * Call fn(ptr, size, allocated, ctx) for every block of
+ * heap h, or of every arena and huge mapping for a NULL h,
+ * without allocating. ptr is the payload and size the bytes
+ * usable from it. Slabs are reported slot by slot and their
+ * never used tail as one free block. The heap is left as it
+ * is: fast-bin blocks show up free, blocks held in thread
+ * caches or remote-free stacks allocated. fn runs under the arena lock
+ * and must not call the allocator; returning nonzero stops
+ * the walk. Returns the last value fn returned, or 0
+ **********************************************************/
+int mm_heap_walk(mm_heap_t* h, mm_walk_fn fn, void* ctx) {
+    int ret = 0;
+    if (h) {
+        ARENA_LOCK(&h->arena);
+        ret = arena_walk(&h->arena, fn, ctx);
+        ARENA_UNLOCK(&h->arena);
+        return ret;
+    }
+    for (int i = 0; !ret && i < NUM_ARENAS; i++) {
+        arena_s* a = &arenas[i];
+        ARENA_LOCK(a);
+        if (a->heap_listp) {
+            ret = arena_walk(a, fn, ctx);
+        }
+        ARENA_UNLOCK(a);
+    }
+    HUGE_LOCK();
+    for (huge_s* m = huge_list; !ret && m; m = m->next) {
+        char* bp = HUGE_PAYLOAD(m);
+        ret = fn(bp, GET_SIZE(HDRP(bp)) - GET(bp - DSIZE), 1, ctx);
+    }
+    HUGE_UNLOCK();
+    return ret;
+}
+
+/**********************************************************
+ * mm_stats
+ * Fill in *st: the counters kept since mm_init when built
+ * with MM_STATS (zero otherwise), and the size and free
+ * blocks of every arena's heap as they are now. Returns 1
+ * if the counters are kept, 0 if not
+ **********************************************************/
+int mm_stats(struct mm_stats* st) {
+#if defined(MM_STATS) && defined(MM_THREAD_SAFE)
+    /* the struct is all size_t; add up the nodes one by one */
+    memset(st, 0, sizeof(*st));
+    for (stats_node_s* n = __atomic_load_n(&stats_nodes, __ATOMIC_ACQUIRE); n; n = n->next) {
+        for (size_t i = 0; i < sizeof(*st) / sizeof(size_t); i++) {
+            ((size_t *)st)[i] += __atomic_load_n(&((size_t *)&n->st)[i], __ATOMIC_RELAXED);
+        }
+    }
+#elif defined(MM_STATS)
+    *st = stats;
+#else
+    memset(st, 0, sizeof(*st));
+#endif
+    st->heap_bytes = 0;
+    memset(st->free_blocks, 0, sizeof(st->free_blocks));
+    memset(st->free_bytes, 0, sizeof(st->free_bytes));
+    for (int i = 0; i < NUM_ARENAS; i++) {
+        arena_s* a = &arenas[i];
+        ARENA_LOCK(a);
+        if (a->heap_listp) {
+            st->heap_bytes += a->heap_size;
+            for (int k = 0; k < LARGE_CLASS; k++) {
+                block_s* head = a->segfit_lists[k];
+                block_s* curr = head;
+                if (!curr) {
+                    continue;
+                }
+                do {
+                    st->free_blocks[k]++;
+                    st->free_bytes[k] += GET_SIZE(HDRP((void *)curr));
+                    curr = curr->next;
+                } while (curr != head);
+            }
+            stats_tree(a->large_root, st);
+        }
+        ARENA_UNLOCK(a);
+    }
+#ifdef MM_STATS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**********************************************************
+ * mm_frag_report
+ * Fill in *fr with how the free space of every arena's heap
+ * is spread over the size classes, from the segregated
+ * lists, the large-block tree and the fast bins. If walk is
+ * nonzero the implicit block chain is walked as well to
+ * count allocated blocks and boundary tags. Returns 1 if
+ * the heap was walked, 0 if not
+ **********************************************************/
+int mm_frag_report(struct mm_frag* fr, int walk) {
+    memset(fr, 0, sizeof(*fr));
+    for (int i = 0; i < NUM_ARENAS; i++) {
+        arena_s* a = &arenas[i];
+        ARENA_LOCK(a);
+        if (!a->heap_listp) {
+            ARENA_UNLOCK(a);
+            continue;
+        }
+        fr->heap_bytes += a->heap_size;
+        for (int k = 0; k < LARGE_CLASS; k++) {
+            block_s* head = a->segfit_lists[k];
+            block_s* curr = head;
+            if (!curr) {
+                continue;
+            }
+            do {
+                frag_add(fr, k, GET_SIZE(HDRP((void *)curr)));
+                curr = curr->next;
+            } while (curr != head);
+        }
+        frag_tree(a->large_root, fr);
+        for (int k = 0; k < NUM_FASTBINS; k++) {
+            for (void* bp = a->fastbins[k]; bp; bp = *(void **)bp) {
+                fr->fast_blocks++;
+                fr->fast_bytes += GET_SIZE(HDRP(bp));
+            }
+        }
+        if (walk) {
+            fr->tag_bytes += 4 * WSIZE;   // padding, prologue and epilogue
+            for (void* bp = NEXT_BLKP(a->heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+                if (GET_ALLOC(HDRP(bp))) {
+                    fr->alloc_blocks++;
+                    fr->alloc_bytes += GET_SIZE(HDRP(bp));
+                    fr->tag_bytes += WSIZE;
+                } else {
+                    fr->tag_bytes += DSIZE;
+                }
+            }
+        }
+        ARENA_UNLOCK(a);
+    }
+    return walk != 0;
+}
+
+/**********************************************************
+ * mm_setopt
+ * Set one of the MM_OPT_* options; call it before other
+ * threads use the allocator. Returns 0 on success, -1 if
+ * opt is unknown
+ **********************************************************/
+int mm_setopt(int opt, size_t value) {
+    switch (opt) {
+    case MM_OPT_MMAP_THRESHOLD:
+        mmap_threshold = value;
+        return 0;
+    case MM_OPT_TRIM_THRESHOLD:
+        trim_threshold = value;
+        return 0;
+    case MM_OPT_GROW_MIN:
+        grow_min = value;
+        return 0;
+    case MM_OPT_GROW_SHIFT:
+        if (value >= 8 * sizeof(size_t)) {
+            return -1;
+        }
+        grow_shift = value;
+        return 0;
+    case MM_OPT_GROW_MAX:
+        grow_max = value;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/**********************************************************
+ * grow_block
+ * Grow the allocated block bp to asize bytes without moving
+ * it, by taking over its free successor and, if bp is the
+ * last block of the heap, extending the heap by what is
+ * still missing. Any usable excess is split off again.
+ * Returns 0 if the block cannot grow in place.
+ * Caller holds the arena lock.
+ **********************************************************/
+static int grow_block(arena_s* a, void *bp, size_t asize) {
+    size_t size = GET_SIZE(HDRP(bp));
+    void* next = NEXT_BLKP(bp);
+    size_t next_size = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+
+    if (size + next_size < asize) {
+        /* only the block at the top of the heap can grow further */
+        void* after = next_size ? NEXT_BLKP(next) : next;
+        if (GET_SIZE(HDRP(after)) != 0) {
+            return 0;
+        }
+        /* the new space coalesces with next, if that is free, which
+           takes next off its list; the result is not listed */
+        if (extend_heap(a, (asize - size - next_size) / WSIZE) == NULL) {
+            return 0;
+        }
+        next_size = GET_SIZE(HDRP(next));
+    } else if (next_size) {
+        segfit_remove(a, (block_s *)next);
+    }
+    size_t rsize = size + next_size - asize;
+    if (rsize >= 2 * DSIZE) {
+        STAT_ADD(splits, 1);
+        PUT(HDRP(bp), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(bp))));
+        void* rp = NEXT_BLKP(bp);
+        PUT(HDRP(rp), PACK(rsize, PREV_ALLOC));
+        PUT(FTRP(rp), PACK(rsize, 0));
+        segfit_insert(a, (block_s *)rp);
+    } else {
+        PUT(HDRP(bp), PACK(size + next_size, 1 | GET_PREV_ALLOC(HDRP(bp))));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    }
+    return 1;
+}
+
+/**********************************************************
+ * mm_check
+ * Check the consistency of the memory heap
+ * Return nonzero if the heap is consistant.
+ * Every initialized arena is checked under its own lock
+ *********************************************************/
+int mm_check(void) {
+    int ok = 1;
+    for (int i = 0; ok && i < NUM_ARENAS; i++) {
+        ok = arena_check(&arenas[i]);
+    }
+    return ok;
+}
+
+/* mm_check for one arena, taking its lock */
+static int arena_check(arena_s* a) {
+    ARENA_LOCK(a);
+    int ok = !a->heap_listp
+        || (mm_free_in_seglist(a)     // checks the seg lists hold the heap's free chunks, each once
+        && mm_alloc_correct(a)        // checks all chunks in seg lists are free
+        && mm_boundary_tags(a)        // checks headers, footers and prev-alloc bits agree
+        && mm_slab_correct(a)         // checks partial slabs are mapped and not full
+        && mm_fastbins_correct(a));   // checks fast bins hold allocated chunks of their size
+    ARENA_UNLOCK(a);
+    return ok;
+}
+
+/**********************************************************
+ * HELPER FUNCTIONS
+ * * arena helpers
+ * * segfit helpers
+ * * slab helpers
+ * * thread cache helpers
+ * * memory check helpers
+ *********************************************************/
+
+#ifdef MM_THREAD_SAFE
+static void arena_space_map(void) {
+    __atomic_store_n(&arena_space, mem_map((size_t)(NUM_ARENAS - 1) * MAX_HEAP),
+                     __ATOMIC_RELEASE);
+}
+#endif
+
+/*
+ * The arena a block belongs to, found from its address: arena 0 owns
+ * the default region, arena i > 0 the i-th MAX_HEAP slice of
+ * arena_space
+ */
+static arena_s* arena_of(void* bp) {
+#ifdef MM_THREAD_SAFE
+    char* space = __atomic_load_n(&arena_space, __ATOMIC_ACQUIRE);
+    size_t off = (char *)bp - space;
+    if (space && off < (size_t)(NUM_ARENAS - 1) * MAX_HEAP) {
+        return &arenas[1 + off / MAX_HEAP];
+    }
+#endif
+    return &arenas[0];
+}
+
+/*
+ * The calling thread's arena. Threads are handed arenas round-robin;
+ * the region of an arena other than 0 is set up here on first use and
+ * its heap by heap_malloc.
+ */
+static arena_s* thread_arena(void) {
+#ifdef MM_THREAD_SAFE
+    tcache_s* tc = tcache_get();
+    if (!tc->arena) {
+        unsigned int i = __atomic_fetch_add(&arena_next, 1, __ATOMIC_RELAXED) % NUM_ARENAS;
+        arena_s* a = &arenas[i];
+        if (i > 0) {
+            pthread_once(&arena_space_once, arena_space_map);
+            if (!__atomic_load_n(&arena_space, __ATOMIC_ACQUIRE)) {
+                return &arenas[0];
+            }
+            ARENA_LOCK(a);
+            if (!a->region) {
+                mem_region_init(&arena_regions[i],
+                                arena_space + (size_t)(i - 1) * MAX_HEAP, MAX_HEAP);
+                a->region = &arena_regions[i];
+            }
+            ARENA_UNLOCK(a);
+        }
+        tc->arena = a;
+    }
+    return tc->arena;
+#else
+    return &arenas[0];
+#endif
+}
+
+/*
+ * Huge blocks live outside every arena region, so a pointer that
+ * arena_of could not place in one is either huge or invalid; the header
+ * bit tells which. The word before the header holds the distance from
+ * the start of the mapping to the payload, and the huge_s links of
+ * huge_list come before it.
+ */
+static int huge_contains(arena_s* a, void* bp) {
+    return (size_t)((char *)bp - a->region->heap) >= MAX_HEAP
+        && GET_MMAPPED(HDRP(bp));
+}
+
+/* Map a block of its own for size bytes with its payload aligned to
+   align (a power of two, at least DSIZE); NULL if the mapping fails */
+static void* huge_alloc(size_t align, size_t size) {
+    size_t page = mem_pagesize();
+    size_t len = (size + sizeof(huge_s) + DSIZE + align + page - 1) / page * page;
+    if (len < size) {
+        return NULL;
+    }
+    char* p = mem_map(len);
+    if (!p) {
+        return NULL;
+    }
+    char* bp = (char *)(((uintptr_t)p + sizeof(huge_s) + DSIZE + align - 1)
+                        & ~(uintptr_t)(align - 1));
+    PUT(bp - DSIZE, bp - p);
+    PUT(HDRP(bp), PACK(len, 1 | MMAPPED));
+    huge_s* m = HUGE_NODE(bp);
+    HUGE_LOCK();
+    m->prev = NULL;
+    m->next = huge_list;
+    if (huge_list) {
+        huge_list->prev = m;
+    }
+    huge_list = m;
+    HUGE_UNLOCK();
+    return bp;
+}
+
+static void huge_free(void* bp) {
+    huge_s* m = HUGE_NODE(bp);
+    HUGE_LOCK();
+    if (m->prev) {
+        m->prev->next = m->next;
+    } else {
+        huge_list = m->next;
+    }
+    if (m->next) {
+        m->next->prev = m->prev;
+    }
+    HUGE_UNLOCK();
+    mem_unmap((char *)bp - GET((char *)bp - DSIZE), GET_SIZE(HDRP(bp)));
+}
+
+/* A huge block stays put while size still fits and is still huge */
+static void* huge_realloc(void* bp, size_t size) {
+    size_t avail = GET_SIZE(HDRP(bp)) - GET((char *)bp - DSIZE);
+    if (size <= avail && size >= mmap_threshold) {
+        return bp;
+    }
+    void* newp = mm_malloc(size);
+    if (!newp) {
+        return NULL;
+    }
+    memcpy(newp, bp, MIN(size, avail));
+    mm_free(bp);    // counted like the mm_malloc above
+    return newp;
+}
+
+/*
+ * Class k > 0 holds sizes in (2^(k+6), 2^(k+7)], so for asize > 128 the
+ * index is ceil(log2(asize)) - HASH_DIFF, which is the bit width of
+ * (asize - 1) minus HASH_DIFF. Small sizes skip even that and use the
+ * table filled in by mm_init.
+ */
+static int segfit_asize2index(size_t asize) {
+    if (asize <= SMALL_CLASS_MAX) {
+        return small_class_table[asize / DSIZE];
+    }
+    return MIN(BIT_WIDTH(asize - 1) - HASH_DIFF, NUM_SIZE_CLASSES - 1);
+}
+
+/* Reference mapping, only used to build small_class_table */
+static int segfit_asize2index_slow(size_t asize) {
+    if (asize <= PW2(HASH_DIFF)) {
+        return 0;
+    } else {
+        int index = HASH_DIFF;
+        while (PW2(index) < asize) {
+            index++;
+        }
+        return MIN((index - HASH_DIFF), (NUM_SIZE_CLASSES - 1));
+    }
+}
+
+static void segfit_remove(arena_s* a, block_s* bp) {
+    size_t bp_asize = GET_SIZE(HDRP((void *)bp));
+    int bp_index = segfit_asize2index(bp_asize);
+    if (bp_index == LARGE_CLASS) {
+        a->large_root = tree_remove(a->large_root, (tree_s *)bp);
+        if (!a->large_root) {
+            a->segfit_bitmap &= ~(1u << LARGE_CLASS);
+        }
+    } else if (bp->next == bp) {
+        a->segfit_lists[bp_index] = NULL;
+        a->segfit_bitmap &= ~(1u << bp_index);
+    } else {
+        bp->prev->next = bp->next;
+        bp->next->prev = bp->prev;
+        if (a->segfit_lists[bp_index] == bp) {
+            a->segfit_lists[bp_index] = bp->next;
+        }
+    }
+}
+
+static void segfit_insert(arena_s* a, block_s* bp) {
+    size_t bp_asize = GET_SIZE(HDRP((void *)bp));
+    int bp_index = segfit_asize2index(bp_asize);
+    if (bp_index == LARGE_CLASS) {
+        a->large_root = tree_insert(a->large_root, (tree_s *)bp);
+        a->segfit_bitmap |= 1u << LARGE_CLASS;
+    } else if (!a->segfit_lists[bp_index]) {
+        a->segfit_bitmap |= 1u << bp_index;
+        a->segfit_lists[bp_index] = bp;
+        bp->next = bp;
+        bp->prev = bp;
+    } else {
+        bp->next = a->segfit_lists[bp_index];
+        bp->prev = a->segfit_lists[bp_index]->prev;
+        bp->prev->next = (block_s *)bp;
+        bp->next->prev = (block_s *)bp;
+    }
+}
+
+/* (size, address) order of the large-block tree */
+static int tree_less(tree_s* x, tree_s* y) {
+    size_t xsize = GET_SIZE(HDRP((void *)x));
+    size_t ysize = GET_SIZE(HDRP((void *)y));
+    return xsize < ysize || (xsize == ysize && x < y);
+}
+
+static void tree_update(tree_s* t) {
+    t->height = 1 + MAX(TREE_HEIGHT(t->left), TREE_HEIGHT(t->right));
+}
+
+static tree_s* tree_rotate_right(tree_s* t) {
+    tree_s* l = t->left;
+    t->left = l->right;
+    l->right = t;
+    tree_update(t);
+    tree_update(l);
+    return l;
+}
+
+static tree_s* tree_rotate_left(tree_s* t) {
+    tree_s* r = t->right;
+    t->right = r->left;
+    r->left = t;
+    tree_update(t);
+    tree_update(r);
+    return r;
+}
+
+/* Restore the AVL property at t after one of its subtrees changed */
+static tree_s* tree_balance(tree_s* t) {
+    long balance = TREE_HEIGHT(t->left) - TREE_HEIGHT(t->right);
+    if (balance > 1) {
+        if (TREE_HEIGHT(t->left->left) < TREE_HEIGHT(t->left->right)) {
+            t->left = tree_rotate_left(t->left);
+        }
+        return tree_rotate_right(t);
+    }
+    if (balance < -1) {
+        if (TREE_HEIGHT(t->right->right) < TREE_HEIGHT(t->right->left)) {
+            t->right = tree_rotate_right(t->right);
+        }
+        return tree_rotate_left(t);
+    }
+    tree_update(t);
+    return t;
+}
+
+/* Insert node into the tree rooted at t, returns the new root */
+static tree_s* tree_insert(tree_s* t, tree_s* node) {
+    if (!t) {
+        node->left = node->right = NULL;
+        node->height = 1;
+        return node;
+    }
+    if (tree_less(node, t)) {
+        t->left = tree_insert(t->left, node);
+    } else {
+        t->right = tree_insert(t->right, node);
+    }
+    return tree_balance(t);
+}
+
+static tree_s* tree_remove_min(tree_s* t, tree_s** min) {
+    if (!t->left) {
+        *min = t;
+        return t->right;
+    }
+    t->left = tree_remove_min(t->left, min);
+    return tree_balance(t);
+}
+
+/* Remove node, which must be in the tree rooted at t, returns the new root */
+static tree_s* tree_remove(tree_s* t, tree_s* node) {
+    if (t == node) {
+        if (!t->right) {
+            return t->left;
+        }
+        tree_s* min;
+        tree_s* right = tree_remove_min(t->right, &min);
+        min->left = t->left;
+        min->right = right;
+        return tree_balance(min);
+    }
+    if (tree_less(node, t)) {
+        t->left = tree_remove(t->left, node);
+    } else {
+        t->right = tree_remove(t->right, node);
+    }
+    return tree_balance(t);
+}
+
+/* The smallest block of at least asize bytes, or NULL */
+static tree_s* tree_best_fit(tree_s* t, size_t asize) {
+    tree_s* fit = NULL;
+    while (t) {
+        if (GET_SIZE(HDRP((void *)t)) >= asize) {
+            fit = t;
+            t = t->left;
+        } else {
+            t = t->right;
+        }
+    }
+    return fit;
+}
+
+/*
+ * A pointer belongs to a slab iff it lies in the arena's region and its
+ * page is marked in the arena's slab_pagemap. Slabs fill their page
+ * completely, so no other block can start on a marked page.
+ */
+static int slab_contains(arena_s* a, void* bp) {
+    size_t off = (char *)bp - a->region->heap;
+    if (off >= MAX_HEAP) {
+        return 0;
+    }
+    size_t page = SLAB_PAGE_INDEX(a, bp);
+    return (PAGEMAP_LOAD(a, page / 64) >> (page % 64)) & 1;
+}
+
+static void slab_unlink(arena_s* a, slab_s* slab) {
+    if (slab->next == slab) {
+        a->slab_partial[slab->klass] = NULL;
+    } else {
+        slab->prev->next = slab->next;
+        slab->next->prev = slab->prev;
+        if (a->slab_partial[slab->klass] == slab) {
+            a->slab_partial[slab->klass] = slab->next;
+        }
+    }
+}
+
+static void slab_link(arena_s* a, slab_s* slab) {
+    slab_s* head = a->slab_partial[slab->klass];
+    if (!head) {
+        slab->next = slab->prev = slab;
+        a->slab_partial[slab->klass] = slab;
+    } else {
+        slab->next = head;
+        slab->prev = head->prev;
+        slab->prev->next = slab;
+        slab->next->prev = slab;
+    }
+}
+
+/* Carve a fresh page-aligned slab for klass out of the heap */
+static slab_s* slab_create(arena_s* a, int klass) {
+    /* a block of exactly SLAB_SIZE ends with the next block's header
+       just before the next aligned page, so slabs can sit side by side */
+    slab_s* slab = alloc_aligned(a, SLAB_SIZE, SLAB_SIZE);
+    if (!slab) {
+        return NULL;
+    }
+    size_t page = SLAB_PAGE_INDEX(a, slab);
+    PAGEMAP_OR(a, page / 64, (uint64_t)1 << (page % 64));
+    slab->free_slots = NULL;
+    slab->klass = klass;
+    slab->used = 0;
+    slab->bump = 0;
+    slab->nslots = (SLAB_SIZE - WSIZE - SLAB_HDR_SIZE) / SLAB_SLOT_SIZE(klass);
+    slab_link(a, slab);
+    return slab;
+}
+
+static void* slab_alloc(arena_s* a, size_t size) {
+    int klass = SLAB_CLASS(size);
+    slab_s* slab = a->slab_partial[klass];
+    void* slot;
+    if (!slab && (slab = slab_create(a, klass)) == NULL) {
+        return NULL;
+    }
+    if (slab->free_slots) {
+        slot = slab->free_slots;
+        slab->free_slots = *(void **)slot;
+    } else {
+        slot = (char *)slab + SLAB_HDR_SIZE + slab->bump * SLAB_SLOT_SIZE(klass);
+        slab->bump++;
+    }
+    if (++slab->used == slab->nslots) {
+        slab_unlink(a, slab);
+    }
+    return slot;
+}
+
+/*
+ * Put the slot back on its slab. An empty slab goes back to the seg
+ * lists, unless it is the only partial slab of its class, which is kept
+ * so that alternating malloc/free does not create and destroy slabs.
+ */
+static void slab_free(arena_s* a, void* bp) {
+    slab_s* slab = (slab_s *)((uintptr_t)bp & ~(uintptr_t)(SLAB_SIZE - 1));
+    if (slab->used-- == slab->nslots) {
+        slab_link(a, slab);
+    }
+    *(void **)bp = slab->free_slots;
+    slab->free_slots = bp;
+    if (slab->used == 0 && slab->next != slab) {
+        slab_destroy(a, slab);
+    }
+}
+
+/* Turn an empty slab back into a free block */
+static void slab_destroy(arena_s* a, slab_s* slab) {
+    size_t page = SLAB_PAGE_INDEX(a, slab);
+    slab_unlink(a, slab);
+    PAGEMAP_AND(a, page / 64, ~((uint64_t)1 << (page % 64)));
+    free_block(a, slab);
+}
+
+/* Destroy the empty slabs slab_free keeps around, one per class at most */
+static void slab_release_empty(arena_s* a) {
+    for (int k = 0; k < NUM_SLAB_CLASSES; k++) {
+        slab_s* slab = a->slab_partial[k];
+        if (slab && slab->used == 0) {
+            slab_destroy(a, slab);
+        }
+    }
+}
+
+#ifdef MM_THREAD_SAFE
+/* Cache bin for a request of size bytes, or -1 if it bypasses the cache */
+static int tcache_bin(size_t size) {
+    if (size <= SLAB_MAX) {
+        return SLAB_CLASS(size);
+    }
+    size_t asize = ADJUSTED_SIZE(size);
+    return asize <= TCACHE_MAX_SIZE ? TCACHE_BLOCK_BIN(asize) : -1;
+}
+
+/* Cache bin for an allocated block, or -1 if it bypasses the cache */
+static int tcache_bin_of(arena_s* a, void* bp) {
+    if (slab_contains(a, bp)) {
+        slab_s* slab = (slab_s *)((uintptr_t)bp & ~(uintptr_t)(SLAB_SIZE - 1));
+        return slab->klass;
+    }
+    size_t asize = GET_OWN_SIZE(HDRP(bp));
+    if (asize < TCACHE_MIN_BLOCK || asize > TCACHE_MAX_SIZE) {
+        return -1;
+    }
+    return TCACHE_BLOCK_BIN(asize);
+}
+
+/* Free every cached block back to the thread's arena, whose lock the caller holds */
+static void tcache_flush(tcache_s* tc) {
+    for (int i = 0; i < TCACHE_BINS; i++) {
+        while (tc->bins[i]) {
+            void* bp = tc->bins[i];
+            tc->bins[i] = *(void **)bp;
+            heap_free(tc->arena, bp);
+        }
+        tc->count[i] = 0;
+    }
+}
+
+/* Runs when a thread exits */
+static void tcache_destroy(void* arg) {
+    tcache_s* tc = arg;
+    arena_s* a = tc->arena;
+    if (!a || tc->gen != __atomic_load_n(&heap_gen, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    ARENA_LOCK(a);
+    remote_drain(a);
+    tcache_flush(tc);
+    ARENA_UNLOCK(a);
+}
+
+static void tcache_make_key(void) {
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/*
+ * The calling thread's cache, emptied first if mm_init has reset the
+ * heap since the cached blocks were obtained
+ */
+static tcache_s* tcache_get(void) {
+    tcache_s* tc = &tcache;
+    unsigned int gen = __atomic_load_n(&heap_gen, __ATOMIC_ACQUIRE);
+    if (tc->gen != gen) {
+        memset(tc->bins, 0, sizeof(tc->bins));
+        memset(tc->count, 0, sizeof(tc->count));
+        tc->gen = gen;
+    }
+    if (!tc->registered) {
+        pthread_once(&tcache_key_once, tcache_make_key);
+        pthread_setspecific(tcache_key, tc);
+        tc->registered = 1;
+    }
+    return tc;
+}
+
+/*
+ * Push a block freed by a thread of another arena. The link lives in
+ * the block's first payload word, as in the thread caches.
+ */
+static void remote_push(arena_s* a, void* bp) {
+    void* head = __atomic_load_n(&a->remote_frees, __ATOMIC_RELAXED);
+    do {
+        *(void **)bp = head;
+    } while (!__atomic_compare_exchange_n(&a->remote_frees, &head, bp, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * Free everything pushed by other threads so far. The stack is only
+ * ever emptied as a whole, so pushers cannot be confused by a block
+ * that is popped and pushed again (ABA). Caller holds the arena lock.
+ */
+static void remote_drain(arena_s* a) {
+    if (!__atomic_load_n(&a->remote_frees, __ATOMIC_RELAXED)) {
+        return;
+    }
+    void* bp = __atomic_exchange_n(&a->remote_frees, NULL, __ATOMIC_ACQUIRE);
+    while (bp) {
+        void* next = *(void **)bp;
+        heap_free(a, bp);
+        bp = next;
+    }
+}
+
+static void* tcache_alloc(int bin, size_t size) {
+    tcache_s* tc = tcache_get();
+    void* bp = tc->bins[bin];
+    if (bp) {
+        tc->bins[bin] = *(void **)bp;
+        tc->count[bin]--;
+        return bp;
+    }
+    /* refill from the thread's arena: one block for the caller
+       plus a batch for later */
+    arena_s* a = thread_arena();
+    ARENA_LOCK(a);
+    bp = heap_malloc(a, size);
+    for (int i = 0; bp && i < TCACHE_BATCH; i++) {
+        void* extra = heap_malloc(a, size);
+        if (!extra) {
+            break;
+        }
+        *(void **)extra = tc->bins[bin];
+        tc->bins[bin] = extra;
+        tc->count[bin]++;
+    }
+    ARENA_UNLOCK(a);
+    return bp;
+}
+
+/*
+ * Returns 0 if bp cannot be cached and must be freed by the caller.
+ * bp belongs to a, the thread's own arena.
+ */
+static int tcache_free(arena_s* a, void* bp) {
+    int bin = tcache_bin_of(a, bp);
+    if (bin < 0) {
+        return 0;
+    }
+    tcache_s* tc = tcache_get();
+    if (tc->count[bin] >= TCACHE_FILL) {
+        /* drain a batch, keeping the most recently freed blocks */
+        void** link = &tc->bins[bin];
+        for (int i = 0; i < TCACHE_FILL - TCACHE_BATCH; i++) {
+            link = (void **)*link;
+        }
+        void* victim = *link;
+        *link = NULL;
+        tc->count[bin] = TCACHE_FILL - TCACHE_BATCH;
+        ARENA_LOCK(a);
+        while (victim) {
+            void* next = *(void **)victim;
+            heap_free(a, victim);
+            victim = next;
+        }
+        ARENA_UNLOCK(a);
+    }
+    *(void **)bp = tc->bins[bin];
+    tc->bins[bin] = bp;
+    tc->count[bin]++;
+    return 1;
+}
+#endif
+
+/**********************************************************
+ * mm_alloc_correct
+ * Checks whether the chunks in seg list are actually free
+ * and filed under the class their size maps to
+ *********************************************************/
+static int mm_alloc_correct(arena_s* a) {
+    if (!a->large_root != !(a->segfit_bitmap & (1u << LARGE_CLASS))) {
+        fprintf(stderr, BAD_SEGLIST_BITMAP);
+        return 0;
+    }
+    if (tree_check(a->large_root) < 0) {
+        return 0;
+    }
+    for (int i = 0; i < LARGE_CLASS; i++) {
+        block_s* head = a->segfit_lists[i];
+        if (!head != !(a->segfit_bitmap & (1u << i))) {
+            fprintf(stderr, BAD_SEGLIST_BITMAP);
+            return 0;
+        }
+        if (!head) {
+            continue;
+        }
+        block_s* curr = head;
         while (1) {
             if (GET_ALLOC(HDRP((void *)curr))) {
                 fprintf(stderr, NONFREE_IN_SEGLIST);
                 return 0;
             }
+            if (segfit_asize2index(GET_SIZE(HDRP((void *)curr))) != i) {
+                fprintf(stderr, WRONG_SEGLIST);
+                return 0;
+            }
             curr = curr->next;
             if (curr == head) {
                 break;
@@ -401,71 +2450,444 @@ static int mm_alloc_correct(void) {
     return 1;
 }
 
+/**********************************************************
+ * tree_check
+ * Checks that every node of the large-block tree is a free
+ * chunk of LARGE_CLASS, that the tree is ordered and that
+ * the stored heights are right and balanced
+ * Returns the height of the tree, or -1 on failure
+ *********************************************************/
+static long tree_check(tree_s* t) {
+    if (!t) {
+        return 0;
+    }
+    if (GET_ALLOC(HDRP((void *)t))) {
+        fprintf(stderr, NONFREE_IN_SEGLIST);
+        return -1;
+    }
+    if (segfit_asize2index(GET_SIZE(HDRP((void *)t))) != LARGE_CLASS) {
+        fprintf(stderr, WRONG_SEGLIST);
+        return -1;
+    }
+    long lh = tree_check(t->left);
+    long rh = tree_check(t->right);
+    if (lh < 0 || rh < 0) {
+        return -1;
+    }
+    if ((t->left && !tree_less(t->left, t)) || (t->right && !tree_less(t, t->right))
+            || t->height != 1 + MAX(lh, rh) || lh - rh > 1 || rh - lh > 1) {
+        fprintf(stderr, BAD_LARGE_TREE);
+        return -1;
+    }
+    return t->height;
+}
+
+/**********************************************************
+ * mm_boundary_tags
+ * Checks that every free chunk's footer matches its header
+ * and that every prev-alloc bit (including the epilogue's)
+ * matches the allocation state of the chunk before it
+ * and that no two free chunks are adjacent
+ * A chunk marked zero is spot-checked past its links and
+ * just before its footer
+ *********************************************************/
+static int mm_boundary_tags(arena_s* a) {
+    size_t prev_alloc = PREV_ALLOC;    // the prologue
+    void* bp = NEXT_BLKP(a->heap_listp);
+    for (; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if (GET_PREV_ALLOC(HDRP(bp)) != prev_alloc) {
+            fprintf(stderr, BAD_PREV_ALLOC);
+            return 0;
+        }
+        if (!GET_ALLOC(HDRP(bp)) && !prev_alloc) {
+            fprintf(stderr, UNCOALESCED);
+            return 0;
+        }
+        if (!GET_ALLOC(HDRP(bp)) && GET_SIZE(FTRP(bp)) != GET_SIZE(HDRP(bp))) {
+            fprintf(stderr, BAD_BOUNDARY_TAGS);
+            return 0;
+        }
+        if (!GET_ALLOC(HDRP(bp)) && GET_ZERO(HDRP(bp))
+                && (char *)bp + ZERO_DIRTY < FTRP(bp)
+                && (GET((char *)bp + ZERO_DIRTY) || GET(FTRP(bp) - WSIZE))) {
+            fprintf(stderr, BAD_ZERO_CHUNK);
+            return 0;
+        }
+        prev_alloc = GET_ALLOC(HDRP(bp)) ? PREV_ALLOC : 0;
+    }
+    if (GET_PREV_ALLOC(HDRP(bp)) != prev_alloc) {
+        fprintf(stderr, BAD_PREV_ALLOC);
+        return 0;
+    }
+    return 1;
+}
+
 /**********************************************************
  * mm_free_in_seglist
- * Checks whether all free chunks in the heap are stored
- * in the corresponding segregated list
- * This procedure is extremly slow
+ * Checks that the seg lists and the large-block tree hold
+ * exactly the free chunks of the heap, each of them once,
+ * in linear time: list entries are marked in a side bitmap
+ * with a bit per DSIZE of heap, then the heap walk looks
+ * every free chunk up in it, clearing its bit again. The
+ * bitmap is kept for the next call and only remapped when
+ * the heap has outgrown it; if it cannot be mapped only the
+ * numbers of chunks are compared
  *********************************************************/
-static int mm_free_in_seglist(void) {
-    for (void* bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
-        size_t asize = GET_SIZE(HDRP(bp));
-        int index = segfit_asize2index(asize);
-        int found_in_seglist = 0;
-        if (GET_ALLOC(HDRP(bp))) {
+static int mm_free_in_seglist(arena_s* a) {
+    size_t len = (a->heap_size / DSIZE / 64 + 1) * sizeof(uint64_t);
+    uint64_t* marks = check_bitmap(a);
+    size_t listed = 0, walked = 0;
+    int ok = 1;
+    for (int i = 0; ok && i < LARGE_CLASS; i++) {
+        block_s* curr = a->segfit_lists[i];
+        if (!curr) {
             continue;
         }
-        for (int i = index; i < NUM_SIZE_CLASSES; i++) {
-            block_s* head = segfit_lists[i];
-            if (!head) {
-                continue;
-            }
-            block_s* curr = head;
-            while (1) {
-                if ((void *)curr == bp) {
-                    found_in_seglist = 1;
-                    break;
-                }
-                curr = curr->next;
-                if (curr == head) {
-                    break;
-                }
-            }
+        do {
+            ok = seglist_mark(a, marks, curr, &listed);
+        } while (ok && (curr = curr->next) != a->segfit_lists[i]);
+    }
+    ok = ok && tree_mark(a, marks, a->large_root, &listed);
+    for (void* bp = NEXT_BLKP(a->heap_listp); ok && GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if (GET_ALLOC(HDRP(bp))) {
+            continue;
         }
-        if (!found_in_seglist) {
+        size_t i = ((char *)bp - a->heap_listp) / DSIZE;
+        walked++;
+        if (marks && !((marks[i / 64] >> (i % 64)) & 1)) {
             fprintf(stderr, FREE_NOT_IN_SEGLIST);
-            return 0;
+            ok = 0;
+        } else if (marks) {
+            marks[i / 64] &= ~((uint64_t)1 << (i % 64));
+        }
+    }
+    if (ok && walked != listed) {
+        fprintf(stderr, marks ? LISTED_NOT_CHUNK : FREE_NOT_IN_SEGLIST);
+        ok = 0;
+    }
+    if (!ok && marks) {
+        /* bits of entries that are no free chunks may be left */
+        memset(marks, 0, len);
+    }
+    return ok;
+}
+
+/*
+ * The side bitmap of arena a, a bit per DSIZE of heap and all zero,
+ * remapped if the heap has outgrown it; NULL if it cannot be mapped.
+ * Users clear the bits they set before they return.
+ */
+static uint64_t* check_bitmap(arena_s* a) {
+    size_t len = (a->heap_size / DSIZE / 64 + 1) * sizeof(uint64_t);
+    if (a->check_len < len) {
+        if (a->check_marks) {
+            mem_unmap(a->check_marks, a->check_len);
+        }
+        a->check_len = (len + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+        a->check_marks = mem_map(a->check_len);    // zeroed
+        if (!a->check_marks) {
+            a->check_len = 0;
         }
     }
+    return a->check_marks;
+}
+
+/*
+ * Mark the seg list entry bp in marks (if not NULL) and count it,
+ * after checking it is a DSIZE aligned address within the heap. A list
+ * that loops back on itself is caught as an entry listed twice, or as
+ * more entries than the heap has room for.
+ */
+static int seglist_mark(arena_s* a, uint64_t* marks, void* bp, size_t* listed) {
+    size_t off = (char *)bp - a->heap_listp;
+    if (off >= a->heap_size || off % DSIZE) {
+        fprintf(stderr, INVALID_ADDR);
+        return 0;
+    }
+    size_t i = off / DSIZE;
+    if (++*listed > a->heap_size / (2 * DSIZE)
+            || (marks && ((marks[i / 64] >> (i % 64)) & 1))) {
+        fprintf(stderr, LISTED_TWICE);
+        return 0;
+    }
+    if (marks) {
+        marks[i / 64] |= (uint64_t)1 << (i % 64);
+    }
     return 1;
 }
 
+/* seglist_mark for every node of the large-block tree t */
+static int tree_mark(arena_s* a, uint64_t* marks, tree_s* t, size_t* listed) {
+    if (!t) {
+        return 1;
+    }
+    return seglist_mark(a, marks, t, listed)
+        && tree_mark(a, marks, t->left, listed)
+        && tree_mark(a, marks, t->right, listed);
+}
+
 /**********************************************************
- * mm_valid_free_address
- * Checks whether each free chunk stored in the seg lists
- * are within the bounds of the currently allocated heap
- * (heap size might change over time, so check address validity
- * immeidately after seg lists are changed)
+ * mm_slab_correct
+ * Checks that every slab on a partial list is marked in
+ * the page map, belongs to that list's class and still
+ * has a free slot
  *********************************************************/
-static int mm_valid_free_address(void) {
-    void* curr_heap_start = heap_listp;
-    void* curr_heap_end = heap_listp + heap_size;
-    for (int i = 0; i < NUM_SIZE_CLASSES; i++) {
-        block_s* head = segfit_lists[i];
+static int mm_slab_correct(arena_s* a) {
+    for (int i = 0; i < NUM_SLAB_CLASSES; i++) {
+        slab_s* head = a->slab_partial[i];
         if (!head) {
             continue;
         }
-        block_s* curr = head;
-        while (1) {
-            if ((void *)curr < curr_heap_start || (void *)curr > curr_heap_end) {
-                fprintf(stderr, INVALID_ADDR);
+        slab_s* curr = head;
+        do {
+            if (!slab_contains(a, curr) || curr->klass != i
+                    || curr->used >= curr->nslots) {
+                fprintf(stderr, BAD_SLAB);
                 return 0;
             }
             curr = curr->next;
-            if (curr == head) {
-                break;
+        } while (curr != head);
+    }
+    return 1;
+}
+
+/**********************************************************
+ * mm_fastbins_correct
+ * Checks that every chunk in a fast bin lies in the heap,
+ * is still marked allocated and has the bin's size
+ *********************************************************/
+static int mm_fastbins_correct(arena_s* a) {
+    char* heap_start = a->heap_listp;
+    char* heap_end = a->heap_listp + a->heap_size;
+    for (int i = 0; i < NUM_FASTBINS; i++) {
+        for (char* bp = a->fastbins[i]; bp; bp = *(char **)bp) {
+            if (bp < heap_start || bp > heap_end) {
+                fprintf(stderr, INVALID_ADDR);
+                return 0;
+            }
+            if (!GET_ALLOC(HDRP(bp)) || FASTBIN(GET_SIZE(HDRP(bp))) != i) {
+                fprintf(stderr, BAD_FASTBIN);
+                return 0;
             }
         }
     }
     return 1;
 }
+
+/*
+ * Statistics helpers
+ */
+
+/* Add the free blocks of the large-block tree t to *st */
+static void stats_tree(tree_s* t, struct mm_stats* st) {
+    if (!t) {
+        return;
+    }
+    st->free_blocks[LARGE_CLASS]++;
+    st->free_bytes[LARGE_CLASS] += GET_SIZE(HDRP((void *)t));
+    stats_tree(t->left, st);
+    stats_tree(t->right, st);
+}
+
+/* Count a free block of class k and size bytes in *fr */
+static void frag_add(struct mm_frag* fr, int k, size_t size) {
+    int bucket = 63 - __builtin_clzl(size);
+    fr->free_blocks++;
+    fr->free_bytes += size;
+    fr->largest_free = MAX(fr->largest_free, size);
+    fr->class_blocks[k]++;
+    fr->class_bytes[k] += size;
+    fr->histogram[MIN(bucket, MM_FRAG_BUCKETS - 1)]++;
+}
+
+/* Add the free blocks of the large-block tree t to *fr */
+static void frag_tree(tree_s* t, struct mm_frag* fr) {
+    if (!t) {
+        return;
+    }
+    frag_add(fr, LARGE_CLASS, GET_SIZE(HDRP((void *)t)));
+    frag_tree(t->left, fr);
+    frag_tree(t->right, fr);
+}
+
+/*
+ * Heap walk helpers
+ */
+
+/* mm_heap_walk for arena a, in address order; caller holds its lock */
+static int arena_walk(arena_s* a, mm_walk_fn fn, void* ctx) {
+    int ret = 0;
+    /* fast-bin blocks are marked in the side bitmap, if there is one */
+    uint64_t* marks = check_bitmap(a);
+    for (int k = 0; marks && k < NUM_FASTBINS; k++) {
+        for (char* bp = a->fastbins[k]; bp; bp = *(char **)bp) {
+            size_t i = (bp - a->heap_listp) / DSIZE;
+            marks[i / 64] |= (uint64_t)1 << (i % 64);
+        }
+    }
+    for (void* bp = NEXT_BLKP(a->heap_listp); !ret && GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if (GET_ALLOC(HDRP(bp)) && slab_contains(a, bp)) {
+            ret = slab_walk(bp, fn, ctx);
+        } else {
+            /* allocated blocks have no footer, free ones keep theirs */
+            int allocated = GET_ALLOC(HDRP(bp)) && !fast_marked(a, marks, bp);
+            ret = fn(bp, GET_SIZE(HDRP(bp)) - (allocated ? WSIZE : DSIZE), allocated, ctx);
+        }
+    }
+    for (int k = 0; marks && k < NUM_FASTBINS; k++) {
+        for (char* bp = a->fastbins[k]; bp; bp = *(char **)bp) {
+            size_t i = (bp - a->heap_listp) / DSIZE;
+            marks[i / 64] &= ~((uint64_t)1 << (i % 64));
+        }
+    }
+    return ret;
+}
+
+/* Whether allocated block bp is parked in a fast bin, by its bit in
+   marks or, without one, by searching the bin of its size */
+static int fast_marked(arena_s* a, uint64_t* marks, void* bp) {
+    size_t asize = GET_SIZE(HDRP(bp));
+    if (asize < FAST_MIN || asize > FAST_MAX) {
+        return 0;
+    }
+    if (marks) {
+        size_t i = ((char *)bp - a->heap_listp) / DSIZE;
+        return (marks[i / 64] >> (i % 64)) & 1;
+    }
+    for (void* p = a->fastbins[FASTBIN(asize)]; p; p = *(void **)p) {
+        if (p == bp) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Report the slots of slab, marking the freed ones on the stack first */
+static int slab_walk(slab_s* slab, mm_walk_fn fn, void* ctx) {
+    uint64_t freed[(SLAB_SIZE / SLAB_GRAIN + 63) / 64] = { 0 };
+    size_t slot_size = SLAB_SLOT_SIZE(slab->klass);
+    char* slots = (char *)slab + SLAB_HDR_SIZE;
+    int ret = 0;
+    for (void* p = slab->free_slots; p; p = *(void **)p) {
+        size_t i = ((char *)p - slots) / slot_size;
+        freed[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+    for (size_t i = 0; !ret && i < slab->bump; i++) {
+        ret = fn(slots + i * slot_size, slot_size, !((freed[i / 64] >> (i % 64)) & 1), ctx);
+    }
+    if (!ret && slab->bump < slab->nslots) {
+        ret = fn(slots + slab->bump * slot_size, (slab->nslots - slab->bump) * slot_size, 0, ctx);
+    }
+    return ret;
+}
+
+#ifdef MM_STATS
+/* Zero the counters; mm_init runs with no other thread inside */
+static void stats_reset(void) {
+#ifdef MM_THREAD_SAFE
+    for (stats_node_s* n = stats_nodes; n; n = n->next) {
+        memset(&n->st, 0, sizeof(n->st));
+    }
+#else
+    memset(&stats, 0, sizeof(stats));
+#endif
+}
+
+#ifdef MM_THREAD_SAFE
+/* Runs when a thread exits: its node is free to be taken over */
+static void stats_release(void* arg) {
+    stats_node_s* n = arg;
+    stats_mine = NULL;
+    __atomic_store_n(&n->used, 0, __ATOMIC_RELEASE);
+}
+
+static void stats_make_key(void) {
+    pthread_key_create(&stats_key, stats_release);
+}
+
+/*
+ * Give the calling thread a node: one left by an exited thread, or a
+ * new one pushed on stats_nodes. If none can be mapped the thread
+ * shares stats_spare, where racing adds may be lost
+ */
+static stats_node_s* stats_get(void) {
+    stats_node_s* n;
+    for (n = __atomic_load_n(&stats_nodes, __ATOMIC_ACQUIRE); n; n = n->next) {
+        int unused = 0;
+        if (__atomic_compare_exchange_n(&n->used, &unused, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (!n && (n = mem_map(sizeof(stats_node_s))) != NULL) {    // zeroed
+        n->used = 1;
+        n->next = __atomic_load_n(&stats_nodes, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&stats_nodes, &n->next, n, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+    if (!n) {
+        return &stats_spare;
+    }
+    pthread_once(&stats_key_once, stats_make_key);
+    pthread_setspecific(stats_key, n);
+    stats_mine = n;
+    return n;
+}
+#endif
+
+/*
+ * Classify the allocated block bp of arena a (NULL: the one its
+ * address says) and set *size to its mapping length, slab class or
+ * block size accordingly
+ */
+static int stats_kind(arena_s* a, void* bp, size_t* size) {
+    if (!a) {
+        a = arena_of(bp);
+    }
+    if (huge_contains(a, bp)) {
+        *size = GET_SIZE(HDRP(bp));
+        return STAT_HUGE;
+    }
+    if (slab_contains(a, bp)) {
+        *size = ((slab_s *)((uintptr_t)bp & ~(uintptr_t)(SLAB_SIZE - 1)))->klass;
+        return STAT_SLAB;
+    }
+    *size = GET_OWN_SIZE(HDRP(bp));
+    return STAT_HEAP;
+}
+
+/* Count a block found by stats_kind as live (sign 1) or gone (-1) */
+static void stats_live(int kind, size_t size, long sign) {
+    if (kind == STAT_HUGE) {
+        STAT_ADD(huge_live_bytes, sign * (long)size);
+    } else if (kind == STAT_SLAB) {
+        STAT_ADD(slab_live_blocks[size], sign);
+    } else {
+        int k = segfit_asize2index(size);
+        STAT_ADD(live_blocks[k], sign);
+        STAT_ADD(live_bytes[k], sign * (long)size);
+    }
+}
+
+/* Count bp as just allocated (sign 1) or about to be freed (-1) */
+static void stats_block(arena_s* a, void* bp, long sign) {
+    size_t size;
+    if (!bp) {
+        return;
+    }
+    int kind = stats_kind(a, bp, &size);
+    stats_live(kind, size, sign);
+    if (sign > 0) {
+        STAT_ADD(mallocs, 1);
+        if (kind == STAT_HUGE) {
+            STAT_ADD(huge_allocs, 1);
+        }
+    } else {
+        STAT_ADD(frees, 1);
+        if (kind == STAT_HUGE) {
+            STAT_ADD(huge_frees, 1);
+        }
+    }
+}
+#endif
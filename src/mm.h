@@ -2,9 +2,105 @@
  *
  * The public interface to the students' memory allocator.
  */
+#include <stdio.h>
 
 int mm_init(void);
 void *mm_malloc(size_t size);
 void mm_free(void *ptr);
 void *mm_realloc(void *ptr, size_t size);
+void *mm_calloc(size_t nmemb, size_t size);
+void mm_free_sized(void *ptr, size_t size);
+size_t mm_usable_size(void *ptr);
+size_t mm_malloc_batch(size_t size, size_t n, void **out);
+void mm_free_batch(void **ptrs, size_t n);
 int mm_check(void);
+
+void *mm_memalign(size_t alignment, size_t size);
+void *mm_aligned_alloc(size_t alignment, size_t size);
+int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+
+/* Options for mm_setopt */
+#define MM_OPT_MMAP_THRESHOLD 1 /* requests of at least this many bytes get their own mapping */
+#define MM_OPT_TRIM_THRESHOLD 2 /* a free block this large at the heap top is given back */
+#define MM_OPT_GROW_MIN 3       /* the heap grows by at least this many bytes */
+#define MM_OPT_GROW_SHIFT 4     /* ... or by its size shifted right by this much */
+#define MM_OPT_GROW_MAX 5       /* ... but by no more than this many bytes */
+
+int mm_setopt(int opt, size_t value);
+int mm_trim(size_t pad);
+
+/* Statistics; the counters are only kept when built with MM_STATS */
+#define MM_STATS_CLASSES 10      /* size classes of the segregated lists */
+#define MM_STATS_SLAB_CLASSES 16 /* slab classes, at most */
+
+struct mm_stats {
+    /* events since mm_init */
+    size_t mallocs;             /* every call that returned a block */
+    size_t frees;
+    size_t reallocs;
+    size_t splits;              /* free blocks cut in two */
+    size_t coalesces[4];        /* no neighbour free, next, prev, both */
+    size_t extends;             /* heap extensions */
+    size_t extend_bytes;
+    size_t trims;               /* heap tops given back */
+    size_t trim_bytes;
+    size_t huge_allocs;         /* blocks with a mapping of their own */
+    size_t huge_frees;
+    /* blocks in use now */
+    size_t live_blocks[MM_STATS_CLASSES];
+    size_t live_bytes[MM_STATS_CLASSES];
+    size_t slab_live_blocks[MM_STATS_SLAB_CLASSES];
+    size_t huge_live_bytes;
+    /* taken by mm_stats itself, kept or not */
+    size_t heap_bytes;
+    size_t free_blocks[MM_STATS_CLASSES];
+    size_t free_bytes[MM_STATS_CLASSES];
+};
+
+int mm_stats(struct mm_stats *st);
+void mm_stats_print(FILE *out, const struct mm_stats *st, int json);
+
+/* Where the free space is, see mm_frag_report */
+#define MM_FRAG_BUCKETS 32 /* histogram[i] counts free blocks of 2^i .. 2^(i+1)-1 bytes */
+
+struct mm_frag {
+    size_t heap_bytes;
+    size_t free_blocks;
+    size_t free_bytes;
+    size_t largest_free;        /* bytes of the largest free block */
+    size_t class_blocks[MM_STATS_CLASSES]; /* free blocks per size class */
+    size_t class_bytes[MM_STATS_CLASSES];
+    size_t histogram[MM_FRAG_BUCKETS];
+    size_t fast_blocks;         /* freed but parked, still marked allocated */
+    size_t fast_bytes;
+    /* only filled in by a walk of the heap */
+    size_t alloc_blocks;        /* slabs and fast-bin blocks included */
+    size_t alloc_bytes;
+    size_t tag_bytes;           /* headers, footers, prologue and epilogue */
+};
+
+int mm_frag_report(struct mm_frag *fr, int walk);
+void mm_frag_print(FILE *out, const struct mm_frag *fr);
+
+/* Heaps of their own; a NULL heap is the one behind mm_malloc */
+typedef struct mm_heap mm_heap_t;
+
+mm_heap_t *mm_heap_create(size_t size);
+void *mm_heap_malloc(mm_heap_t *heap, size_t size);
+void mm_heap_free(mm_heap_t *heap, void *ptr);
+size_t mm_heap_usable_size(mm_heap_t *heap, void *ptr);
+void mm_heap_destroy(mm_heap_t *heap);
+int mm_heap_check(mm_heap_t *heap);
+
+/* Called by mm_heap_walk for every block; nonzero stops the walk */
+typedef int (*mm_walk_fn)(void *ptr, size_t size, int allocated, void *ctx);
+
+int mm_heap_walk(mm_heap_t *heap, mm_walk_fn fn, void *ctx);
+
+/* Bump-pointer regions, see mm_region.c */
+typedef struct mm_region mm_region_t;
+
+mm_region_t *mm_region_create(size_t chunk_size);
+void *mm_region_alloc(mm_region_t *r, size_t size);
+void mm_region_reset(mm_region_t *r);
+void mm_region_destroy(mm_region_t *r);
@@ -0,0 +1,140 @@
+/*
+ * mm_region.c - bump-pointer regions on top of either engine
+ *
+ * A region hands out memory by moving a pointer through chunks it gets
+ * from mm_memalign, so its objects carry no headers and are never freed
+ * one by one. mm_region_reset rewinds the region to its first chunk and
+ * keeps every chunk for reuse; mm_region_destroy gives them back.
+ * A region is not thread-safe; use one per thread or guard it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mm.h"
+
+#define ALIGNMENT 16
+#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~(size_t)(ALIGNMENT - 1))
+#define REGION_CHUNK (64 * 1024) /* default bytes per chunk, header included */
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+
+/* A chunk header keeps the data after it aligned */
+typedef struct chunk_t {
+    struct chunk_t* next;
+    size_t size;            /* bytes of data after the header */
+} chunk_s;
+
+#define CHUNK_DATA(c) ((char *)(c) + ALIGN(sizeof(chunk_s)))
+
+struct mm_region {
+    chunk_s* first;         /* chunks in the order they are used */
+    chunk_s* cur;           /* the chunk bump points into */
+    char* bump;             /* next free byte of cur */
+    char* end;              /* end of cur */
+    size_t chunk_size;
+};
+
+static void* region_refill(mm_region_t*, size_t);
+
+/**********************************************************
+ * mm_region_create
+ * Make an empty region whose chunks hold chunk_size bytes,
+ * or REGION_CHUNK if chunk_size is 0. No chunk is
+ * allocated until the first mm_region_alloc
+ **********************************************************/
+mm_region_t* mm_region_create(size_t chunk_size) {
+    mm_region_t* r = mm_malloc(sizeof(mm_region_t));
+    if (!r) {
+        return NULL;
+    }
+    r->first = r->cur = NULL;
+    r->bump = r->end = NULL;
+    if (chunk_size == 0) {
+        chunk_size = REGION_CHUNK;
+    }
+    r->chunk_size = MAX(chunk_size, 2 * ALIGN(sizeof(chunk_s)));
+    return r;
+}
+
+/**********************************************************
+ * mm_region_alloc
+ * Allocate size bytes, aligned to ALIGNMENT, that live
+ * until the region is reset or destroyed
+ **********************************************************/
+void* mm_region_alloc(mm_region_t* r, size_t size) {
+    if (size == 0 || size > SIZE_MAX - (ALIGNMENT - 1)) {
+        return NULL;
+    }
+    size = ALIGN(size);
+    if (size <= (size_t)(r->end - r->bump)) {
+        void* p = r->bump;
+        r->bump += size;
+        return p;
+    }
+    return region_refill(r, size);
+}
+
+/**********************************************************
+ * region_refill
+ * Move on to the next kept chunk that can hold size bytes,
+ * or chain a new one after the current chunk, and allocate
+ * from it. Kept chunks that are too small are skipped until
+ * the next reset
+ **********************************************************/
+static void* region_refill(mm_region_t* r, size_t size) {
+    chunk_s* c = r->cur ? r->cur->next : r->first;
+    while (c && c->size < size) {
+        c = c->next;
+    }
+    if (!c) {
+        size_t data = MAX(r->chunk_size - ALIGN(sizeof(chunk_s)), size);
+        if (data + ALIGN(sizeof(chunk_s)) < data) {
+            return NULL;
+        }
+        /* mm_malloc only promises 8 bytes in a compact build */
+        c = mm_memalign(ALIGNMENT, ALIGN(sizeof(chunk_s)) + data);
+        if (!c) {
+            return NULL;
+        }
+        c->size = data;
+        if (r->cur) {
+            c->next = r->cur->next;
+            r->cur->next = c;
+        } else {
+            c->next = r->first;
+            r->first = c;
+        }
+    }
+    r->cur = c;
+    r->bump = CHUNK_DATA(c) + size;
+    r->end = CHUNK_DATA(c) + c->size;
+    return CHUNK_DATA(c);
+}
+
+/**********************************************************
+ * mm_region_reset
+ * Free everything allocated from the region at once by
+ * rewinding it; its chunks are reused
+ **********************************************************/
+void mm_region_reset(mm_region_t* r) {
+    r->cur = NULL;
+    r->bump = r->end = NULL;
+}
+
+/**********************************************************
+ * mm_region_destroy
+ * Give the region and all its chunks back to mm_free
+ **********************************************************/
+void mm_region_destroy(mm_region_t* r) {
+    if (!r) {
+        return;
+    }
+    chunk_s* c = r->first;
+    while (c) {
+        chunk_s* next = c->next;
+        mm_free(c);
+        c = next;
+    }
+    mm_free(r);
+}
@@ -0,0 +1,113 @@
+/*
+ * mm_stats.c - print a struct mm_stats or mm_frag for either engine
+ *
+ * mm_stats_print writes a snapshot taken by mm_stats as text, one
+ * name/value pair per line and a table per size class, or as a single
+ * JSON object whose keys are the field names of struct mm_stats.
+ * mm_frag_print writes the free-space report of mm_frag_report.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mm.h"
+
+#define COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+static void print_array(FILE*, const char*, const size_t*, size_t);
+
+/**********************************************************
+ * mm_stats_print
+ * Write st to out, as JSON if json is nonzero and as text
+ * otherwise
+ **********************************************************/
+void mm_stats_print(FILE* out, const struct mm_stats* st, int json) {
+    static const char* const cases[] = { "none", "next", "prev", "both" };
+
+    if (json) {
+        fprintf(out, "{\"mallocs\": %zu, \"frees\": %zu, \"reallocs\": %zu, "
+                "\"splits\": %zu, ", st->mallocs, st->frees, st->reallocs, st->splits);
+        print_array(out, "coalesces", st->coalesces, COUNT(st->coalesces));
+        fprintf(out, "\"extends\": %zu, \"extend_bytes\": %zu, "
+                "\"trims\": %zu, \"trim_bytes\": %zu, "
+                "\"huge_allocs\": %zu, \"huge_frees\": %zu, ",
+                st->extends, st->extend_bytes, st->trims, st->trim_bytes,
+                st->huge_allocs, st->huge_frees);
+        print_array(out, "live_blocks", st->live_blocks, COUNT(st->live_blocks));
+        print_array(out, "live_bytes", st->live_bytes, COUNT(st->live_bytes));
+        print_array(out, "slab_live_blocks", st->slab_live_blocks,
+                    COUNT(st->slab_live_blocks));
+        fprintf(out, "\"huge_live_bytes\": %zu, \"heap_bytes\": %zu, ",
+                st->huge_live_bytes, st->heap_bytes);
+        print_array(out, "free_blocks", st->free_blocks, COUNT(st->free_blocks));
+        fprintf(out, "\"free_bytes\": [");
+        for (size_t i = 0; i < COUNT(st->free_bytes); i++) {
+            fprintf(out, "%s%zu", i ? ", " : "", st->free_bytes[i]);
+        }
+        fprintf(out, "]}\n");
+        return;
+    }
+
+    fprintf(out, "mallocs %zu\nfrees %zu\nreallocs %zu\nsplits %zu\n",
+            st->mallocs, st->frees, st->reallocs, st->splits);
+    for (size_t i = 0; i < COUNT(st->coalesces); i++) {
+        fprintf(out, "coalesces.%s %zu\n", cases[i], st->coalesces[i]);
+    }
+    fprintf(out, "extends %zu (%zu bytes)\ntrims %zu (%zu bytes)\n",
+            st->extends, st->extend_bytes, st->trims, st->trim_bytes);
+    fprintf(out, "huge allocs %zu, frees %zu, live bytes %zu\n",
+            st->huge_allocs, st->huge_frees, st->huge_live_bytes);
+    fprintf(out, "heap bytes %zu\n", st->heap_bytes);
+    fprintf(out, "%5s %12s %12s %12s %12s\n",
+            "class", "live_blocks", "live_bytes", "free_blocks", "free_bytes");
+    for (size_t i = 0; i < MM_STATS_CLASSES; i++) {
+        fprintf(out, "%5zu %12zu %12zu %12zu %12zu\n", i, st->live_blocks[i],
+                st->live_bytes[i], st->free_blocks[i], st->free_bytes[i]);
+    }
+    fprintf(out, "%5s %12s\n", "slab", "live_blocks");
+    for (size_t i = 0; i < MM_STATS_SLAB_CLASSES; i++) {
+        if (st->slab_live_blocks[i]) {
+            fprintf(out, "%5zu %12zu\n", i, st->slab_live_blocks[i]);
+        }
+    }
+}
+
+/**********************************************************
+ * mm_frag_print
+ * Write fr to out as text. External fragmentation is the
+ * share of the free bytes outside the largest free block:
+ * near 0 when the free space is one block, near 1 when it
+ * is spread over many small ones
+ **********************************************************/
+void mm_frag_print(FILE* out, const struct mm_frag* fr) {
+    double ext = fr->free_bytes ? 1.0 - (double)fr->largest_free / fr->free_bytes : 0.0;
+
+    fprintf(out, "heap bytes %zu\n", fr->heap_bytes);
+    fprintf(out, "free blocks %zu (%zu bytes), largest %zu\n",
+            fr->free_blocks, fr->free_bytes, fr->largest_free);
+    fprintf(out, "external fragmentation %.3f\n", ext);
+    fprintf(out, "fast-bin blocks %zu (%zu bytes)\n", fr->fast_blocks, fr->fast_bytes);
+    if (fr->tag_bytes) {
+        fprintf(out, "allocated blocks %zu (%zu bytes)\n", fr->alloc_blocks, fr->alloc_bytes);
+        fprintf(out, "boundary tags %zu bytes (%.2f%% of the heap)\n", fr->tag_bytes,
+                fr->heap_bytes ? 100.0 * fr->tag_bytes / fr->heap_bytes : 0.0);
+    }
+    fprintf(out, "%5s %12s %12s\n", "class", "free_blocks", "free_bytes");
+    for (size_t i = 0; i < MM_STATS_CLASSES; i++) {
+        fprintf(out, "%5zu %12zu %12zu\n", i, fr->class_blocks[i], fr->class_bytes[i]);
+    }
+    fprintf(out, "%12s %12s\n", "free size >=", "blocks");
+    for (size_t i = 0; i < MM_FRAG_BUCKETS; i++) {
+        if (fr->histogram[i]) {
+            fprintf(out, "%12zu %12zu\n", (size_t)1 << i, fr->histogram[i]);
+        }
+    }
+}
+
+/* Write "name": [a0, a1, ...], as one member of a JSON object */
+static void print_array(FILE* out, const char* name, const size_t* a, size_t n) {
+    fprintf(out, "\"%s\": [", name);
+    for (size_t i = 0; i < n; i++) {
+        fprintf(out, "%s%zu", i ? ", " : "", a[i]);
+    }
+    fprintf(out, "], ");
+}
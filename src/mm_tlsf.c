@@ -0,0 +1,679 @@
+/*
+ * mm_tlsf.c - two-level segregated fit (TLSF) allocation engine
+ *
+ * An alternative to the segregated lists in mm.c with the same mm.h
+ * interface; select it with "meson setup build -Dengine=tlsf".
+ *
+ * Free blocks are kept in FL_COUNT x SL_COUNT exact-range lists. The
+ * first level splits sizes by power of two, the second level divides
+ * each power-of-two range into SL_COUNT linear steps. A first-level
+ * bitmap and one second-level bitmap per first level record which lists
+ * are non-empty, so both malloc and free run in constant time: a search
+ * is two find-first-set operations, never a walk along a list.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/*************************************************************************
+ * Basic Constants and Macros
+ *************************************************************************/
+#define WSIZE sizeof(void *) /* word size (bytes) */
+#define DSIZE (2 * WSIZE)    /* doubleword size (bytes) */
+#define CHUNKSIZE (1 << 7)   /* minimum heap extension (bytes) */
+#define MIN_BLOCK (2 * DSIZE)
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+/* Pack a size and allocated bit into a word */
+#define PACK(size, alloc) ((size) | (alloc))
+
+/* Read and write a word at address p */
+#define GET(p) (*(uintptr_t *)(p))
+#define PUT(p, val) (*(uintptr_t *)(p) = (val))
+
+/* Read the size and allocated fields from address p */
+#define GET_SIZE(p) (GET(p) & ~(DSIZE - 1))
+#define GET_ALLOC(p) (GET(p) & 0x1)
+
+/* Given block ptr bp, compute address of its header and footer */
+#define HDRP(bp) ((char *)(bp) - WSIZE)
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+
+/* Given block ptr bp, compute address of next and previous blocks */
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
+#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
+
+/* Index of the most significant set bit of x (x > 0) */
+#define MSB(x) ((int)(8 * sizeof(unsigned long)) - 1 - __builtin_clzl(x))
+
+/*
+ * Second level: 2^SL_LOG2 lists per power of two.
+ * Sizes below SMALL_BLOCK all live in first level 0, which is split
+ * linearly in DSIZE steps; first level f > 0 holds
+ * [2^(f + FL_SHIFT - 1), 2^(f + FL_SHIFT)).
+ */
+#define SL_LOG2 (4)
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + 4) /* log2(SL_COUNT * DSIZE) */
+#define SMALL_BLOCK (1 << FL_SHIFT)
+#define FL_MAX_LOG2 (32)
+#define FL_COUNT (FL_MAX_LOG2 - FL_SHIFT + 1)
+
+#define NONFREE_IN_LIST ("[ERROR] mm_check() fails: non-free chunk appears in free list\n")
+#define WRONG_LIST ("[ERROR] mm_check() fails: free chunk stored in the wrong list\n")
+#define BAD_BITMAP ("[ERROR] mm_check() fails: bitmaps disagree with free lists\n")
+#define BAD_FREE_SIZE ("[ERROR] mm_free_sized() fails: size does not fit the block\n")
+#define INVALID_ADDR ("[ERROR] mm_check() fails: free chunk has invalid address\n")
+#define FREE_NOT_IN_LIST ("[ERROR] mm_check() fails: free chunk not found in free list\n")
+#define UNCOALESCED ("[ERROR] mm_check() fails: adjacent free chunks were not coalesced\n")
+
+typedef struct block_t {
+    struct block_t* prev;
+    struct block_t* next;
+} block_s;
+
+static void* heap_listp = NULL;
+static unsigned int fl_bitmap = 0;
+static unsigned int sl_bitmap[FL_COUNT];
+static block_s* tlsf_lists[FL_COUNT][SL_COUNT];
+
+static void tlsf_mapping(size_t, int*, int*);
+static block_s* tlsf_search(size_t);
+static void tlsf_insert(block_s*);
+static void tlsf_remove(block_s*);
+
+/**********************************************************
+ * mm_init
+ * Initialize the heap, including "allocation" of the
+ * prologue and epilogue
+ **********************************************************/
+int mm_init(void) {
+    if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1)
+        return -1;
+    PUT(heap_listp, 0);                            // alignment padding
+    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1)); // prologue header
+    PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); // prologue footer
+    PUT(heap_listp + (3 * WSIZE), PACK(0, 1));     // epilogue header
+    heap_listp += DSIZE;
+    fl_bitmap = 0;
+    memset(sl_bitmap, 0, sizeof(sl_bitmap));
+    memset(tlsf_lists, 0, sizeof(tlsf_lists));
+    return 0;
+}
+
+/**********************************************************
+ * coalesce
+ * Merge bp with whichever neighbours are free. The
+ * neighbours are taken off their lists; the caller
+ * inserts the result.
+ **********************************************************/
+static void* coalesce(void *bp) {
+    size_t prev_alloc = GET_ALLOC(HDRP(bp) - WSIZE);
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (!next_alloc) {
+        tlsf_remove((block_s *)NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+    }
+    if (!prev_alloc) {
+        bp = PREV_BLKP(bp);
+        tlsf_remove((block_s *)bp);
+        size += GET_SIZE(HDRP(bp));
+    }
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    return bp;
+}
+
+/**********************************************************
+ * extend_heap
+ * Extend the heap by size bytes and return the new free
+ * block, merged with a free block at the old heap top.
+ * The block is not on any list.
+ **********************************************************/
+static void* extend_heap(size_t size) {
+    char *bp;
+
+    /* mem_sbrk takes an int */
+    if (size > INT_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if ((bp = mem_sbrk(size)) == (void *)-1)
+        return NULL;
+    PUT(HDRP(bp), PACK(size, 0));         // free block header
+    PUT(FTRP(bp), PACK(size, 0));         // free block footer
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); // new epilogue header
+    return coalesce(bp);
+}
+
+/**********************************************************
+ * place
+ * Mark a block that is on no list as allocated, returning
+ * the tail to the lists if it is big enough to stand alone
+ **********************************************************/
+static void place(void *bp, size_t asize) {
+    size_t bsize = GET_SIZE(HDRP(bp));
+    size_t rsize = bsize - asize;
+    if (rsize >= MIN_BLOCK) {
+        PUT(HDRP(bp), PACK(asize, 1));
+        PUT(FTRP(bp), PACK(asize, 1));
+        void* rp = NEXT_BLKP(bp);
+        PUT(HDRP(rp), PACK(rsize, 0));
+        PUT(FTRP(rp), PACK(rsize, 0));
+        tlsf_insert((block_s *)rp);
+    } else {
+        PUT(HDRP(bp), PACK(bsize, 1));
+        PUT(FTRP(bp), PACK(bsize, 1));
+    }
+}
+
+/**********************************************************
+ * mm_free
+ * Free the block and coalesce with neighbouring blocks
+ **********************************************************/
+void mm_free(void *bp) {
+    if (bp == NULL) return;
+    size_t size = GET_SIZE(HDRP(bp));
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    tlsf_insert((block_s *)coalesce(bp));
+}
+
+/**********************************************************
+ * mm_free_sized
+ * mm_free for a block whose requested size the caller
+ * knows; the size is only checked in MM_DEBUG builds
+ **********************************************************/
+void mm_free_sized(void *bp, size_t size) {
+#ifdef MM_DEBUG
+    if (bp != NULL && size > mm_usable_size(bp)) {
+        fprintf(stderr, BAD_FREE_SIZE);
+        abort();
+    }
+#else
+    (void)size;
+#endif
+    mm_free(bp);
+}
+
+/**********************************************************
+ * mm_usable_size
+ * Payload bytes of the block at bp; 0 for NULL
+ **********************************************************/
+size_t mm_usable_size(void *bp) {
+    return bp ? GET_SIZE(HDRP(bp)) - DSIZE : 0;
+}
+
+/**********************************************************
+ * mm_malloc
+ * Allocate a block of size bytes. A good fit is found
+ * with two bitmap scans; if there is none the heap is
+ * extended.
+ **********************************************************/
+void* mm_malloc(size_t size) {
+    size_t asize;
+    void *bp;
+
+    if (size == 0) {
+        return NULL;
+    }
+    if (size > MAX_HEAP) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    asize = (size <= DSIZE) ?
+            2 * DSIZE : DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+
+    if ((bp = tlsf_search(asize)) != NULL) {
+        tlsf_remove(bp);
+    } else if ((bp = extend_heap(MAX(asize, CHUNKSIZE))) == NULL) {
+        return NULL;
+    }
+    place(bp, asize);
+    return bp;
+}
+
+/**********************************************************
+ * mm_calloc
+ * Allocate a zeroed array of nmemb elements of size bytes.
+ * TLSF blocks keep no record of fresh memory, so the whole
+ * payload is cleared
+ **********************************************************/
+void* mm_calloc(size_t nmemb, size_t size) {
+    size_t bytes;
+    void* bp;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if ((bp = mm_malloc(bytes)) != NULL) {
+        memset(bp, 0, bytes);
+    }
+    return bp;
+}
+
+/**********************************************************
+ * mm_realloc
+ * Shrink in place, grow into a free successor when it is
+ * large enough, otherwise move the payload to a new block
+ *********************************************************/
+void *mm_realloc(void *ptr, size_t size) {
+    if (size == 0) {
+        mm_free(ptr);
+        return NULL;
+    }
+    if (ptr == NULL) {
+        return mm_malloc(size);
+    }
+    if (size > MAX_HEAP) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t new_asize = (size <= DSIZE) ?
+            2 * DSIZE : DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    size_t old_asize = GET_SIZE(HDRP(ptr));
+    void* next = NEXT_BLKP(ptr);
+    if (new_asize > old_asize && !GET_ALLOC(HDRP(next))
+            && old_asize + GET_SIZE(HDRP(next)) >= new_asize) {
+        tlsf_remove((block_s *)next);
+        old_asize += GET_SIZE(HDRP(next));
+        PUT(HDRP(ptr), PACK(old_asize, 1));
+        PUT(FTRP(ptr), PACK(old_asize, 1));
+    }
+    if (new_asize <= old_asize) {
+        size_t rsize = old_asize - new_asize;
+        if (rsize >= MIN_BLOCK) {
+            PUT(HDRP(ptr), PACK(new_asize, 1));
+            PUT(FTRP(ptr), PACK(new_asize, 1));
+            void* rp = NEXT_BLKP(ptr);
+            PUT(HDRP(rp), PACK(rsize, 0));
+            PUT(FTRP(rp), PACK(rsize, 0));
+            tlsf_insert((block_s *)coalesce(rp));
+        }
+        return ptr;
+    }
+    void* newptr = mm_malloc(size);
+    if (!newptr) {
+        return NULL;
+    }
+    memcpy(newptr, ptr, old_asize - DSIZE);
+    mm_free(ptr);
+    return newptr;
+}
+
+/**********************************************************
+ * mm_memalign
+ * Allocate a block of size bytes whose payload is aligned
+ * to alignment, a power of two, by finding a block with
+ * room to spare and splitting the slack in front of the
+ * payload off as a free block
+ **********************************************************/
+void* mm_memalign(size_t alignment, size_t size) {
+    char *bp, *ap;
+
+    if (alignment == 0 || (alignment & (alignment - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (alignment <= DSIZE) {
+        return mm_malloc(size);
+    }
+    if (size == 0) {
+        return NULL;
+    }
+    if (size > MAX_HEAP || alignment > MAX_HEAP) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t asize = (size <= DSIZE) ?
+            2 * DSIZE : DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    /* enough to leave a leading block of at least MIN_BLOCK */
+    size_t req = asize + alignment + MIN_BLOCK;
+
+    if ((bp = (char *)tlsf_search(req)) != NULL) {
+        tlsf_remove((block_s *)bp);
+    } else if ((bp = extend_heap(MAX(req, CHUNKSIZE))) == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    ap = (char *)(((uintptr_t)bp + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    if (ap != bp && ap - bp < MIN_BLOCK) {
+        ap += alignment;
+    }
+    if (ap != bp) {
+        /* bp's predecessor is allocated, so the lead stays separate */
+        size_t bsize = GET_SIZE(HDRP(bp));
+        size_t lead = ap - bp;
+        PUT(HDRP(bp), PACK(lead, 0));
+        PUT(FTRP(bp), PACK(lead, 0));
+        tlsf_insert((block_s *)bp);
+        PUT(HDRP(ap), PACK(bsize - lead, 0));
+    }
+    place(ap, asize);
+    return ap;
+}
+
+/**********************************************************
+ * mm_aligned_alloc
+ * C11 aligned_alloc on top of mm_memalign
+ **********************************************************/
+void* mm_aligned_alloc(size_t alignment, size_t size) {
+    return mm_memalign(alignment, size);
+}
+
+/**********************************************************
+ * mm_posix_memalign
+ * POSIX posix_memalign: alignment must also be a multiple
+ * of sizeof(void *). Returns 0, EINVAL or ENOMEM and leaves
+ * *memptr alone on failure
+ **********************************************************/
+int mm_posix_memalign(void** memptr, size_t alignment, size_t size) {
+    if (alignment == 0 || alignment % sizeof(void *)
+            || (alignment & (alignment - 1))) {
+        return EINVAL;
+    }
+    void* bp = mm_memalign(alignment, size);
+    if (!bp && size) {
+        return ENOMEM;
+    }
+    *memptr = bp;
+    return 0;
+}
+
+/**********************************************************
+ * mm_malloc_batch
+ * Allocate n blocks of size bytes into out[0..n). Returns
+ * how many were allocated
+ **********************************************************/
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+    size_t i = 0;
+    while (i < n && (out[i] = mm_malloc(size)) != NULL) {
+        i++;
+    }
+    return i;
+}
+
+/**********************************************************
+ * mm_free_batch
+ * Free the n blocks in ptrs[]
+ **********************************************************/
+void mm_free_batch(void **ptrs, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        mm_free(ptrs[i]);
+    }
+}
+
+/**********************************************************
+ * mm_heap_create
+ * The TLSF engine has a single heap, so there are no
+ * others to create; the NULL heap is that one
+ **********************************************************/
+mm_heap_t* mm_heap_create(size_t size) {
+    (void)size;
+    return NULL;
+}
+
+void* mm_heap_malloc(mm_heap_t* h, size_t size) {
+    return h ? NULL : mm_malloc(size);
+}
+
+void mm_heap_free(mm_heap_t* h, void* bp) {
+    if (!h) {
+        mm_free(bp);
+    }
+}
+
+size_t mm_heap_usable_size(mm_heap_t* h, void* bp) {
+    return h ? 0 : mm_usable_size(bp);
+}
+
+void mm_heap_destroy(mm_heap_t* h) {
+    (void)h;
+}
+
+int mm_heap_check(mm_heap_t* h) {
+    return h ? 0 : mm_check();
+}
+
+/**********************************************************
+ * mm_heap_walk
+ * Call fn(ptr, size, allocated, ctx) for every block of the
+ * heap in address order; size is what lies between the
+ * header and the footer. Returns the last value fn
+ * returned, or 0; -1 for a heap other than NULL
+ **********************************************************/
+int mm_heap_walk(mm_heap_t* h, mm_walk_fn fn, void* ctx) {
+    int ret = 0;
+    if (h) {
+        return -1;
+    }
+    if (!heap_listp) {
+        return 0;
+    }
+    for (void* bp = NEXT_BLKP(heap_listp); !ret && GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        ret = fn(bp, GET_SIZE(HDRP(bp)) - DSIZE, GET_ALLOC(HDRP(bp)) != 0, ctx);
+    }
+    return ret;
+}
+
+/**********************************************************
+ * mm_setopt
+ * The TLSF engine has no tunable options
+ **********************************************************/
+int mm_setopt(int opt, size_t value) {
+    (void)opt;
+    (void)value;
+    return -1;
+}
+
+/**********************************************************
+ * mm_trim
+ * The TLSF engine never shrinks its heap
+ **********************************************************/
+int mm_trim(size_t pad) {
+    (void)pad;
+    return 0;
+}
+
+/**********************************************************
+ * mm_stats
+ * The TLSF engine keeps no counters; only the heap size
+ * is filled in
+ **********************************************************/
+int mm_stats(struct mm_stats* st) {
+    memset(st, 0, sizeof(*st));
+    st->heap_bytes = mem_heapsize();
+    return 0;
+}
+
+/**********************************************************
+ * mm_frag_report
+ * Fill in *fr from the TLSF lists, and from a walk of the
+ * heap if walk is nonzero. Its lists do not follow the
+ * segfit size classes, so the per-class counts stay zero;
+ * there are no fast bins either. Returns 1 if the heap was
+ * walked, 0 if not
+ **********************************************************/
+int mm_frag_report(struct mm_frag* fr, int walk) {
+    memset(fr, 0, sizeof(*fr));
+    if (!heap_listp) {
+        return 0;
+    }
+    fr->heap_bytes = mem_heapsize();
+    for (int fl = 0; fl < FL_COUNT; fl++) {
+        for (int sl = 0; sl < SL_COUNT; sl++) {
+            for (block_s* curr = tlsf_lists[fl][sl]; curr; curr = curr->next) {
+                size_t size = GET_SIZE(HDRP(curr));
+                fr->free_blocks++;
+                fr->free_bytes += size;
+                fr->largest_free = MAX(fr->largest_free, size);
+                fr->histogram[MIN(MSB(size), MM_FRAG_BUCKETS - 1)]++;
+            }
+        }
+    }
+    if (walk) {
+        fr->tag_bytes = 4 * WSIZE;   // padding, prologue and epilogue
+        for (void* bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+            fr->tag_bytes += DSIZE;  // every block has a footer
+            if (GET_ALLOC(HDRP(bp))) {
+                fr->alloc_blocks++;
+                fr->alloc_bytes += GET_SIZE(HDRP(bp));
+            }
+        }
+    }
+    return walk != 0;
+}
+
+/**********************************************************
+ * mm_check
+ * Check the consistency of the memory heap
+ * Return nonzero if the heap is consistant.
+ * Every list entry must be free, within the heap and
+ * filed where its size maps; the heap walk must find the
+ * same number of free blocks, none of them adjacent.
+ *********************************************************/
+int mm_check(void) {
+    void* heap_lo = mem_heap_lo();
+    void* heap_hi = mem_heap_hi();
+    size_t listed = 0, walked = 0;
+
+    for (int fl = 0; fl < FL_COUNT; fl++) {
+        if (!(fl_bitmap & (1u << fl)) != !sl_bitmap[fl]) {
+            fprintf(stderr, BAD_BITMAP);
+            return 0;
+        }
+        for (int sl = 0; sl < SL_COUNT; sl++) {
+            block_s* curr = tlsf_lists[fl][sl];
+            if (!curr != !(sl_bitmap[fl] & (1u << sl))) {
+                fprintf(stderr, BAD_BITMAP);
+                return 0;
+            }
+            for (; curr; curr = curr->next) {
+                int f, s;
+                if ((void *)curr < heap_lo || (void *)curr > heap_hi) {
+                    fprintf(stderr, INVALID_ADDR);
+                    return 0;
+                }
+                if (GET_ALLOC(HDRP(curr))) {
+                    fprintf(stderr, NONFREE_IN_LIST);
+                    return 0;
+                }
+                tlsf_mapping(GET_SIZE(HDRP(curr)), &f, &s);
+                if (f != fl || s != sl) {
+                    fprintf(stderr, WRONG_LIST);
+                    return 0;
+                }
+                listed++;
+            }
+        }
+    }
+    for (void* bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if (GET_ALLOC(HDRP(bp))) {
+            continue;
+        }
+        if (!GET_ALLOC(HDRP(NEXT_BLKP(bp)))) {
+            fprintf(stderr, UNCOALESCED);
+            return 0;
+        }
+        walked++;
+    }
+    if (walked != listed) {
+        fprintf(stderr, FREE_NOT_IN_LIST);
+        return 0;
+    }
+    return 1;
+}
+
+/**********************************************************
+ * HELPER FUNCTIONS
+ * * tlsf index computation
+ * * tlsf list maintenance
+ *********************************************************/
+
+/* Map a block size to the list that holds it */
+static void tlsf_mapping(size_t size, int* fl, int* sl) {
+    if (size < SMALL_BLOCK) {
+        *fl = 0;
+        *sl = size / DSIZE;
+    } else {
+        int msb = MSB(size);
+        *sl = (size >> (msb - SL_LOG2)) ^ SL_COUNT;
+        *fl = msb - FL_SHIFT + 1;
+    }
+}
+
+/*
+ * Find a free block of at least asize bytes. The request is rounded up
+ * to the next list boundary first, so any block in the list found is
+ * large enough and no list needs to be scanned.
+ */
+static block_s* tlsf_search(size_t asize) {
+    int fl, sl;
+    if (asize >= SMALL_BLOCK) {
+        asize += ((size_t)1 << (MSB(asize) - SL_LOG2)) - 1;
+    }
+    tlsf_mapping(asize, &fl, &sl);
+    if (fl >= FL_COUNT) {
+        return NULL;
+    }
+    unsigned int sl_map = sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        if (fl + 1 >= FL_COUNT) {
+            return NULL;
+        }
+        unsigned int fl_map = fl_bitmap & (~0u << (fl + 1));
+        if (!fl_map) {
+            return NULL;
+        }
+        fl = __builtin_ctz(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+    return tlsf_lists[fl][sl];
+}
+
+static void tlsf_insert(block_s* bp) {
+    int fl, sl;
+    tlsf_mapping(GET_SIZE(HDRP(bp)), &fl, &sl);
+    block_s* head = tlsf_lists[fl][sl];
+    bp->prev = NULL;
+    bp->next = head;
+    if (head) {
+        head->prev = bp;
+    }
+    tlsf_lists[fl][sl] = bp;
+    fl_bitmap |= 1u << fl;
+    sl_bitmap[fl] |= 1u << sl;
+}
+
+static void tlsf_remove(block_s* bp) {
+    int fl, sl;
+    tlsf_mapping(GET_SIZE(HDRP(bp)), &fl, &sl);
+    if (bp->next) {
+        bp->next->prev = bp->prev;
+    }
+    if (bp->prev) {
+        bp->prev->next = bp->next;
+    } else {
+        tlsf_lists[fl][sl] = bp->next;
+        if (!bp->next) {
+            sl_bitmap[fl] &= ~(1u << sl);
+            if (!sl_bitmap[fl]) {
+                fl_bitmap &= ~(1u << fl);
+            }
+        }
+    }
+}